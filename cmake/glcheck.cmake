@@ -0,0 +1,8 @@
+# CHECK_GL_ERROR (lib/debuggl.h) calls glGetError after every wrapped GL
+# call, which stalls many drivers. Release builds can compile it out:
+#	cmake -DGL_ERROR_CHECKS=OFF ..
+OPTION(GL_ERROR_CHECKS "Check glGetError after every CHECK_GL_ERROR call" ON)
+IF (NOT GL_ERROR_CHECKS)
+	ADD_DEFINITIONS(-DDEBUGGL_NO_CHECKS)
+	MESSAGE(STATUS "GL error checks compiled out")
+ENDIF ()
@@ -1,6 +1,10 @@
+#include <GL/glew.h>
 #include "debuggl.h"
 #include <portable_gl.h>
 #include <GLFW/glfw3.h>
+#include <iostream>
+
+bool debugglPollErrors = true;
 
 const char* DebugGLErrorToString(int error) {
 	switch (error) {
@@ -30,3 +34,31 @@ void debugglTerminate()
 {
 	glfwTerminate();
 }
+
+// The driver may call this from its own thread, after the call that
+// caused the message has returned, so it only reports.
+static void GLAPIENTRY debugglCallback(GLenum /*source*/, GLenum type, GLuint id,
+		GLenum severity, GLsizei /*length*/, const GLchar* message, const void* /*user*/)
+{
+	const char* level = "low";
+	if (severity == GL_DEBUG_SEVERITY_HIGH)
+		level = "high";
+	else if (severity == GL_DEBUG_SEVERITY_MEDIUM)
+		level = "medium";
+	std::cerr << "OpenGL " << (type == GL_DEBUG_TYPE_ERROR ? "error" : "message")
+	          << " (" << level << ", id " << id << "): " << message << std::endl;
+}
+
+bool debugglUseCallback()
+{
+	if (!GLEW_KHR_debug)
+		return false;
+	glDebugMessageCallback(debugglCallback, nullptr);
+	// Notifications are informational chatter (buffer placement and the
+	// like) on most drivers.
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION,
+	                      0, nullptr, GL_FALSE);
+	glEnable(GL_DEBUG_OUTPUT);
+	debugglPollErrors = false;
+	return true;
+}
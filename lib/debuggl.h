@@ -3,6 +3,19 @@
 
 void debugglTerminate();
 
+/*
+ * CHECK_GL_ERROR calls glGetError after the statement, which makes many
+ * drivers synchronize. Two ways to avoid that:
+ *      build time: define DEBUGGL_NO_CHECKS (cmake -DGL_ERROR_CHECKS=OFF)
+ *                  and CHECK_GL_ERROR is the bare statement
+ *      run time: debugglUseCallback() has the driver report errors
+ *                through a KHR_debug callback and stops the polling;
+ *                it returns false, and keeps polling, without KHR_debug
+ * Shader and program status checks stay, they run once per compile.
+ */
+extern bool debugglPollErrors;
+bool debugglUseCallback();
+
 #define CHECK_SUCCESS(x)   \
   do {                     \
     if (!(x)) {            \
@@ -46,17 +59,24 @@ void debugglTerminate();
     }                                                                        \
   } while (0)
 
+#ifdef DEBUGGL_NO_CHECKS
+#define CHECK_GL_ERROR(statement)                                             \
+  do {                                                                        \
+    { statement; }                                                            \
+  } while (0)
+#else
 #define CHECK_GL_ERROR(statement)                                             \
   do {                                                                        \
     { statement; }                                                            \
     GLenum error = GL_NO_ERROR;                                               \
-    if ((error = glGetError()) != GL_NO_ERROR) {                              \
+    if (debugglPollErrors && (error = glGetError()) != GL_NO_ERROR) {         \
       std::cerr << __func__ << " Line :" << __LINE__ << " OpenGL Error: code  = " << error \
                 << " description =  " << DebugGLErrorToString(int(error));    \
       debugglTerminate();                                                        \
       exit(EXIT_FAILURE);                                                     \
     }                                                                         \
   } while (0)
+#endif
 
 const char* DebugGLErrorToString(int error);
 
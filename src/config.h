@@ -22,4 +22,18 @@ const float kFloorZMin = -100.0f;
 const float kFloorZMax = 100.0f;
 const float kFloorY = -0.75617 - kFloorEps;
 
+// Terrain level of detail (TerrainLod).
+const int kLodPatchQuads = 32;      // quads along each edge of a patch
+const float kLodRangeFactor = 2.0f; // split nodes closer than this times their size
+const float kLodSkirtDepth = 0.25f; // skirt drop, as a fraction of the height scale
+
+// Streamed terrain (TerrainStream).
+const int kStreamTileQuads = 32;      // quads along each edge of a tile
+const int kStreamRadius = 12;         // tiles kept around the camera along each axis
+const int kStreamBudgetMB = 64;       // tile meshes resident at once
+const int kStreamUploadsPerFrame = 8; // finished tiles uploaded per frame at most
+
+// GPU timing (GpuTimer).
+const int kGpuTimerWindow = 120; // frames the statistics cover
+
 #endif
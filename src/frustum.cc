@@ -0,0 +1,28 @@
+#include "frustum.h"
+
+Frustum::Frustum(const glm::mat4& m)
+{
+	// Gribb and Hartmann: a point is inside when -w <= x, y, z <= w in
+	// clip space, i.e. (row3 +- row_i) . p >= 0.
+	for (int i = 0; i < 3; i++) {
+		for (int side = 0; side < 2; side++) {
+			glm::vec4& plane = planes_[2 * i + side];
+			float sign = side ? -1.0f : 1.0f;
+			for (int c = 0; c < 4; c++)
+				plane[c] = m[c][3] + sign * m[c][i];
+		}
+	}
+}
+
+bool Frustum::intersects(const glm::vec3& lo, const glm::vec3& hi) const
+{
+	for (const glm::vec4& plane : planes_) {
+		// The box corner furthest along the plane normal.
+		glm::vec3 corner(plane.x >= 0.0f ? hi.x : lo.x,
+		                 plane.y >= 0.0f ? hi.y : lo.y,
+		                 plane.z >= 0.0f ? hi.z : lo.z);
+		if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
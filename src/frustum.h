@@ -0,0 +1,21 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+/*
+ * Frustum: the six clip planes of a projection * view matrix, for culling
+ * axis aligned boxes given in the same world space.
+ */
+class Frustum {
+public:
+	explicit Frustum(const glm::mat4& projection_view);
+
+	// False only if the box lies entirely outside one of the planes.
+	// Boxes near a corner may pass without being visible.
+	bool intersects(const glm::vec3& lo, const glm::vec3& hi) const;
+private:
+	glm::vec4 planes_[6]; // xyz: inward normal, w: offset
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <GL/glew.h>
+#include "gpu_perlin.h"
+#include "gpu_timer.h"
+#include "height_texture.h"
+#include "program_cache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <debuggl.h>
+
+namespace {
+
+const char* fullscreen_vertex_shader =
+#include "shaders/fullscreen.vert"
+;
+
+const char* perlin_fragment_shader =
+#include "shaders/perlin.frag"
+;
+
+GLuint compile(const char* source, GLenum type)
+{
+	GLuint shader = 0;
+	CHECK_GL_ERROR(shader = glCreateShader(type));
+	CHECK_GL_ERROR(glShaderSource(shader, 1, &source, nullptr));
+	glCompileShader(shader);
+	CHECK_GL_SHADER_ERROR(shader);
+	return shader;
+}
+
+}
+
+GpuPerlin::GpuPerlin()
+{
+	CHECK_GL_ERROR(program_ = glCreateProgram());
+	CHECK_GL_ERROR(glBindFragDataLocation(program_, 0, "height"));
+	uint64_t key = ProgramCache::key();
+	key = ProgramCache::mix(key, fullscreen_vertex_shader);
+	key = ProgramCache::mix(key, perlin_fragment_shader);
+	key = ProgramCache::mix(key, "height");
+	if (!ProgramCache::load(program_, key)) {
+		GLuint vs = compile(fullscreen_vertex_shader, GL_VERTEX_SHADER);
+		GLuint fs = compile(perlin_fragment_shader, GL_FRAGMENT_SHADER);
+		CHECK_GL_ERROR(glAttachShader(program_, vs));
+		CHECK_GL_ERROR(glAttachShader(program_, fs));
+		ProgramCache::prepare(program_);
+		glLinkProgram(program_);
+		CHECK_GL_PROGRAM_ERROR(program_);
+		ProgramCache::store(program_, key);
+		// The program keeps them alive while attached.
+		CHECK_GL_ERROR(glDeleteShader(vs));
+		CHECK_GL_ERROR(glDeleteShader(fs));
+	}
+
+	CHECK_GL_ERROR(glGenTextures(1, &permutation_));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_1D, permutation_));
+	// Integer textures are incomplete with linear filtering.
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	uploadPermutation(seed_);
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_1D, 0));
+
+	CHECK_GL_ERROR(glGenFramebuffers(1, &fbo_));
+	// Core profile draws need a VAO even without attributes.
+	CHECK_GL_ERROR(glGenVertexArrays(1, &vao_));
+}
+
+GpuPerlin::~GpuPerlin()
+{
+	CHECK_GL_ERROR(glDeleteVertexArrays(1, &vao_));
+	CHECK_GL_ERROR(glDeleteFramebuffers(1, &fbo_));
+	CHECK_GL_ERROR(glDeleteTextures(1, &permutation_));
+	CHECK_GL_ERROR(glDeleteProgram(program_));
+}
+
+// Expects permutation_ to be bound to GL_TEXTURE_1D.
+void GpuPerlin::uploadPermutation(unsigned seed)
+{
+	// The table is stored doubled; the shader wraps indices itself.
+	const uint8_t* table = PermutationTable::forSeed(seed).p;
+	CHECK_GL_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	CHECK_GL_ERROR(glTexImage1D(GL_TEXTURE_1D, 0, GL_R8UI, 256, 0,
+				GL_RED_INTEGER, GL_UNSIGNED_BYTE, table));
+	CHECK_GL_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+	seed_ = seed;
+}
+
+void GpuPerlin::render(const HeightMapParams& params, int z, HeightTexture& target)
+{
+	static const int timer_section = GpuTimer::section("gpu noise");
+	GpuTimer::begin(timer_section);
+	target.allocate(params.sizeX, params.sizeY);
+
+	GLint viewport[4], framebuffer, program, vao;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+	GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean cull = glIsEnabled(GL_CULL_FACE);
+
+	CHECK_GL_ERROR(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo_));
+	CHECK_GL_ERROR(glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+				GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.id(), 0));
+	CHECK_SUCCESS(glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	// Texel (y, x) holds grid point (x, y).
+	CHECK_GL_ERROR(glViewport(0, 0, params.sizeY, params.sizeX));
+	CHECK_GL_ERROR(glDisable(GL_DEPTH_TEST));
+	CHECK_GL_ERROR(glDisable(GL_BLEND));
+	CHECK_GL_ERROR(glDisable(GL_CULL_FACE));
+
+	CHECK_GL_ERROR(glUseProgram(program_));
+	CHECK_GL_ERROR(glActiveTexture(GL_TEXTURE0 + 0));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_1D, permutation_));
+	if (params.seed != seed_)
+		uploadPermutation(params.seed);
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(program_, "permutation"), 0));
+	CHECK_GL_ERROR(glUniform2i(glGetUniformLocation(program_, "map_size"), params.sizeX, params.sizeY));
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(program_, "slice"), z));
+	HeightField field(params);
+	int cells = field.periodCells() ? field.periodCells() : 256;
+	int gridPeriod = params.period > 0 ? params.period : params.sizeX + params.sizeY;
+	CHECK_GL_ERROR(glUniform1f(glGetUniformLocation(program_, "noise_scale"), field.step()));
+	CHECK_GL_ERROR(glUniform3i(glGetUniformLocation(program_, "period"), cells, cells, 256));
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(program_, "grid_period"), gridPeriod));
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(program_, "map_type"), params.type));
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(program_, "octaves"), params.octaves ? std::min(params.numOctaves, maxPerlinOctaves) : 0));
+	CHECK_GL_ERROR(glUniform1f(glGetUniformLocation(program_, "persistence"), (float)params.persistence));
+	CHECK_GL_ERROR(glUniform1f(glGetUniformLocation(program_, "height_scale"), (float)params.heightScale));
+	CHECK_GL_ERROR(glUniform1f(glGetUniformLocation(program_, "power"), (float)params.power));
+	CHECK_GL_ERROR(glBindVertexArray(vao_));
+	CHECK_GL_ERROR(glDrawArrays(GL_TRIANGLES, 0, 3));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_1D, 0));
+
+	CHECK_GL_ERROR(glBindVertexArray(vao));
+	CHECK_GL_ERROR(glUseProgram(program));
+	CHECK_GL_ERROR(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer));
+	CHECK_GL_ERROR(glViewport(viewport[0], viewport[1], viewport[2], viewport[3]));
+	if (depth)
+		CHECK_GL_ERROR(glEnable(GL_DEPTH_TEST));
+	if (blend)
+		CHECK_GL_ERROR(glEnable(GL_BLEND));
+	if (cull)
+		CHECK_GL_ERROR(glEnable(GL_CULL_FACE));
+}
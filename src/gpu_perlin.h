@@ -0,0 +1,44 @@
+#ifndef GPU_PERLIN_H
+#define GPU_PERLIN_H
+
+#include "terrain_generator.h"
+
+class HeightTexture;
+
+/*
+ * GpuPerlin: HeightField::generate on the GPU.
+ *
+ * shaders/perlin.frag ports PerlinF::perlinPeriodic, OctavePerlinPeriodic
+ * and the map type transforms; render() runs it over a full screen
+ * triangle into a HeightTexture through a framebuffer object. The permutation table is
+ * an R8UI texture, replaced when the seed changes. Only GL 3.3 core
+ * features are used, so it also runs on Mesa llvmpipe.
+ *
+ * Results follow the CPU reference within float rounding: the shader
+ * compiler may contract multiply-adds that the CPU keeps separate.
+ */
+class GpuPerlin {
+public:
+	GpuPerlin();
+	~GpuPerlin();
+	GpuPerlin(const GpuPerlin&) = delete;
+	GpuPerlin& operator=(const GpuPerlin&) = delete;
+
+	/*
+	 * render: write slice z of the height map params describes into
+	 * target, (re)allocating it as sizeX x sizeY. GL state touched by
+	 * the pass (viewport, framebuffer, program, VAO, depth test,
+	 * blending, culling) is restored afterwards.
+	 */
+	void render(const HeightMapParams& params, int z, HeightTexture& target);
+private:
+	void uploadPermutation(unsigned seed);
+
+	unsigned program_ = 0;
+	unsigned fbo_ = 0;
+	unsigned vao_ = 0;
+	unsigned permutation_ = 0;
+	unsigned seed_ = 0; // seed of the table in permutation_
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <GL/glew.h>
+#include "gpu_timer.h"
+#include "config.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <debuggl.h>
+
+void GpuTimer::setEnabled(bool enabled)
+{
+	if (!enabled && running_ >= 0) {
+		CHECK_GL_ERROR(glEndQuery(GL_TIME_ELAPSED));
+		running_ = -1;
+	}
+	enabled_ = enabled;
+}
+
+void GpuTimer::setCsv(const std::string& path)
+{
+	csv_.open(path);
+	if (!csv_)
+		throw __func__+std::string(": error, can't write ")+path;
+	csv_ << "frame,section,ms\n";
+	enabled_ = true;
+}
+
+int GpuTimer::section(const std::string& name)
+{
+	auto iter = ids_.find(name);
+	if (iter != ids_.end())
+		return iter->second;
+	int id = int(names_.size());
+	names_.push_back(name);
+	samples_.emplace_back();
+	ids_[name] = id;
+	return id;
+}
+
+void GpuTimer::begin(int section)
+{
+	if (!enabled_)
+		return;
+	if (running_ >= 0)
+		CHECK_GL_ERROR(glEndQuery(GL_TIME_ELAPSED));
+	unsigned query;
+	if (free_queries_.empty()) {
+		CHECK_GL_ERROR(glGenQueries(1, &query));
+	} else {
+		query = free_queries_.back();
+		free_queries_.pop_back();
+	}
+	CHECK_GL_ERROR(glBeginQuery(GL_TIME_ELAPSED, query));
+	current_.queries.push_back({ section, query });
+	running_ = section;
+}
+
+void GpuTimer::endFrame()
+{
+	if (!enabled_)
+		return;
+	if (running_ >= 0)
+		CHECK_GL_ERROR(glEndQuery(GL_TIME_ELAPSED));
+	running_ = -1;
+	current_.number = frame_number_++;
+	pending_.push_back(std::move(current_));
+	current_ = Frame();
+
+	// Frames finish in order, so stop at the first that has not.
+	while (!pending_.empty() && finished(pending_.front())) {
+		record(pending_.front());
+		for (const Query& q : pending_.front().queries)
+			free_queries_.push_back(q.query);
+		pending_.pop_front();
+	}
+}
+
+bool GpuTimer::finished(const Frame& frame)
+{
+	for (const Query& q : frame.queries) {
+		GLint available = 0;
+		CHECK_GL_ERROR(glGetQueryObjectiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+			return false;
+	}
+	return true;
+}
+
+void GpuTimer::record(const Frame& frame)
+{
+	// The first frame pays for first-use work, and llvmpipe times the
+	// first query of a context from an arbitrary start, so skip it.
+	if (frame.number == 0)
+		return;
+	std::vector<double> ms(names_.size(), -1.0);
+	for (const Query& q : frame.queries) {
+		GLuint64 ns = 0;
+		CHECK_GL_ERROR(glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &ns));
+		ms[q.section] = std::max(ms[q.section], 0.0) + ns * 1e-6;
+	}
+	// Sections that did not run this frame are left out rather than
+	// counted as free.
+	for (size_t i = 0; i < ms.size(); i++) {
+		if (ms[i] < 0.0)
+			continue;
+		auto& window = samples_[i];
+		window.push_back(ms[i]);
+		if (int(window.size()) > kGpuTimerWindow)
+			window.pop_front();
+		if (csv_.is_open())
+			csv_ << frame.number << "," << names_[i] << "," << ms[i] << "\n";
+	}
+}
+
+std::vector<GpuTimer::Stats> GpuTimer::stats()
+{
+	std::vector<Stats> ret;
+	for (size_t i = 0; i < names_.size(); i++) {
+		const auto& window = samples_[i];
+		if (window.empty())
+			continue;
+		Stats s;
+		s.name = names_[i];
+		s.samples = int(window.size());
+		s.last = window.back();
+		s.min = *std::min_element(window.begin(), window.end());
+		s.max = *std::max_element(window.begin(), window.end());
+		s.mean = 0.0;
+		for (double v : window)
+			s.mean += v;
+		s.mean /= window.size();
+		ret.push_back(s);
+	}
+	return ret;
+}
+
+void GpuTimer::print(std::ostream& out)
+{
+	std::vector<Stats> all = stats();
+	if (all.empty())
+		return;
+	out << "GPU ms per frame, last " << kGpuTimerWindow << " frames at most (mean / min / max):\n";
+	for (const Stats& s : all)
+		out << "  " << std::setw(12) << std::left << s.name << std::right << std::fixed
+		    << std::setprecision(3) << s.mean << " / " << s.min << " / " << s.max << "\n";
+	out.unsetf(std::ios::floatfield);
+	out << std::setprecision(6);
+}
+
+bool GpuTimer::enabled_ = false;
+int GpuTimer::running_ = -1;
+long GpuTimer::frame_number_ = 0;
+GpuTimer::Frame GpuTimer::current_;
+std::deque<GpuTimer::Frame> GpuTimer::pending_;
+std::vector<unsigned> GpuTimer::free_queries_;
+std::vector<std::string> GpuTimer::names_;
+std::map<std::string, int> GpuTimer::ids_;
+std::vector<std::deque<double>> GpuTimer::samples_;
+std::ofstream GpuTimer::csv_;
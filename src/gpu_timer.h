@@ -0,0 +1,75 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <deque>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * GpuTimer: GPU time per section of a frame, measured with
+ * GL_TIME_ELAPSED queries. Every RenderPass is a section, begun by its
+ * setup(); GpuPerlin is another.
+ *
+ * begin() ends the running section's query and starts one for the new
+ * section, so a section's time covers everything issued from its begin()
+ * to the next begin() or endFrame(). Sections begun several times in a
+ * frame (one setup() per LOD node) add up.
+ *
+ * Results are never waited for: endFrame() reads back only frames whose
+ * queries have all finished, usually two or three frames late, and feeds
+ * them into statistics over the last kGpuTimerWindow frames and, if set,
+ * a CSV file with one row per section and frame.
+ *
+ * Disabled by default, in which case every call returns at once.
+ */
+class GpuTimer {
+public:
+	// Milliseconds per frame over the window.
+	struct Stats {
+		std::string name;
+		int samples;
+		double last, mean, min, max;
+	};
+
+	static void setEnabled(bool enabled);
+	static bool enabled() { return enabled_; }
+	// setCsv: also write every frame read back to path, as
+	// frame,section,ms rows. Enables the timer.
+	static void setCsv(const std::string& path);
+
+	// Id of the section called name, added if it is new.
+	static int section(const std::string& name);
+	static void begin(int section);
+	static void endFrame();
+
+	static std::vector<Stats> stats();
+	// Prints stats() as a table.
+	static void print(std::ostream& out);
+private:
+	struct Query {
+		int section;
+		unsigned query;
+	};
+	struct Frame {
+		long number;
+		std::vector<Query> queries;
+	};
+	static bool finished(const Frame& frame);
+	static void record(const Frame& frame);
+
+	static bool enabled_;
+	static int running_; // section whose query is running, -1 for none
+	static long frame_number_;
+	static Frame current_;
+	static std::deque<Frame> pending_;
+	static std::vector<unsigned> free_queries_;
+	static std::vector<std::string> names_;
+	static std::map<std::string, int> ids_;
+	static std::vector<std::deque<double>> samples_; // ms, by section
+	static std::ofstream csv_;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "gui.h"
 #include "config.h"
+#include "gpu_timer.h"
+#include "perlin.h"
 //#include <jpegio.h>
 #include <iostream>
 #include <debuggl.h>
@@ -45,6 +47,40 @@ void GUI::keyCallback(int key, int scancode, int action, int mods)
 	{
 		this->reset();
 	}
+	else if(key == GLFW_KEY_G && action != GLFW_RELEASE)
+	{
+		static const char* modes[] = { "CPU mesh", "GPU height slice", "GPU height volume",
+		                               "Streamed CPU tiles" };
+		terrainMode = (terrainMode + 1) % 4;
+		std::cout << "Terrain mode: " << modes[terrainMode] << std::endl;
+	}
+	else if(key == GLFW_KEY_L && action != GLFW_RELEASE)
+	{
+		lod = !lod;
+		std::cout << "Level of detail " << (lod ? "on" : "off") << " (GPU modes)" << std::endl;
+	}
+	else if(key == GLFW_KEY_MINUS && action != GLFW_RELEASE)
+	{
+		playbackSpeed /= 2.0;
+		std::cout << "Playback speed: " << playbackSpeed << " slices per frame" << std::endl;
+	}
+	else if(key == GLFW_KEY_EQUAL && action != GLFW_RELEASE)
+	{
+		if(playbackSpeed < 8.0)
+			playbackSpeed *= 2.0;
+		std::cout << "Playback speed: " << playbackSpeed << " slices per frame" << std::endl;
+	}
+	else if(key == GLFW_KEY_N && action != GLFW_RELEASE)
+	{
+		++seed;
+		dirty = true;
+		advance = false;
+		displayValues();
+	}
+	else if(key == GLFW_KEY_P && action != GLFW_RELEASE)
+	{
+		displayValues();
+	}
 	else if(key == GLFW_KEY_O && action != GLFW_RELEASE)
 	{
 		toggleOctave = !toggleOctave;
@@ -65,7 +101,8 @@ void GUI::keyCallback(int key, int scancode, int action, int mods)
 	{
 		if(toggleOctave)
 		{
-			++octaves;
+			if(octaves < maxPerlinOctaves)
+				++octaves;
 			dirty = true;
 			advance = false;
 			displayValues();
@@ -174,6 +211,7 @@ void GUI::displayValues()
 {
 	std::cout << ">>>>>>>>>>>>>>>>\n";
 	std::cout << "Using octaves: " << toggleOctave << "\n";
+	std::cout << "Seed: " << seed << "\n";
 	std::cout << "Height: " << height << "\n";
 	std::cout << "Octaves: " << octaves << "\n";
 	std::cout << "Persistence: " << persistence << "\n";
@@ -182,6 +220,7 @@ void GUI::displayValues()
 		std::cout << sinPow << "\n";
 	else
 		std::cout << ringPow << "\n";
+	GpuTimer::print(std::cout);
 	std::cout << ">>>>>>>>>>>>>>>>" << std::endl;
 }
 
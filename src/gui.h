@@ -24,6 +24,8 @@ public:
 	void mouseButtonCallback(int button, int action, int mods);
 	void updateMatrices();
 	MatrixPointers getMatrixPointers() const;
+	const glm::mat4& getViewMatrix() const { return view_matrix_; }
+	const glm::mat4& getProjectionMatrix() const { return projection_matrix_; }
 
 	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void MousePosCallback(GLFWwindow* window, double mouse_x, double mouse_y);
@@ -39,6 +41,11 @@ public:
 	bool isDirty() { return dirty; }
 	void setClean() { dirty = false; }
 	int getMapType() { return mapType; }
+	// 0: CPU mesh, 1: GPU height slice, 2: GPU height volume,
+	// 3: streamed CPU tiles around the camera
+	int getTerrainMode() { return terrainMode; }
+	double getPlaybackSpeed() { return playbackSpeed; }
+	bool useLod() { return lod; }
 
 	bool useOctaves() { return toggleOctave; }
 	int numOctaves() { return octaves; }
@@ -46,6 +53,8 @@ public:
 	double getPersistence() { return persistence; }
 	double getSinPow() { return sinPow; }
 	double getRingPow() { return ringPow; }
+	unsigned getSeed() { return seed; }
+	void setSeed(unsigned s) { seed = s; }
 
 	void displayValues();
 
@@ -69,6 +78,9 @@ private:
 	bool advance = false;
 	bool dirty = false;
 	int mapType = 1;
+	int terrainMode = 0;
+	double playbackSpeed = 1.0;
+	bool lod = false;
 
 	bool toggleOctave = false;
 	int octaves = 1;
@@ -76,6 +88,7 @@ private:
 	double persistence = 0.1;
 	double sinPow = 0.0;
 	double ringPow = 0.0;
+	unsigned seed = 0;
 
 	glm::vec3 eye_ = glm::vec3(5.0f, 1.0f, camera_distance_);
 	glm::vec3 up_ = glm::vec3(0.0f, 1.0f, 0.0f);
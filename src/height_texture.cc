@@ -0,0 +1,141 @@
+#include <GL/glew.h>
+#include "height_texture.h"
+#include "height_volume.h"
+#include <cstdlib>
+#include <iostream>
+#include <debuggl.h>
+
+HeightTexture::HeightTexture()
+{
+	CHECK_GL_ERROR(glGenTextures(1, &tex_));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, tex_));
+	// The shader reads exact texels with texelFetch.
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+HeightTexture::~HeightTexture()
+{
+	CHECK_GL_ERROR(glDeleteTextures(1, &tex_));
+}
+
+void HeightTexture::upload(const float* heights, int sizeX, int sizeY)
+{
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, tex_));
+	if (sizeX != size_x_ || sizeY != size_y_) {
+		CHECK_GL_ERROR(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F,
+					sizeY, sizeX, 0,
+					GL_RED, GL_FLOAT, heights));
+		size_x_ = sizeX;
+		size_y_ = sizeY;
+	} else {
+		CHECK_GL_ERROR(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+					sizeY, sizeX,
+					GL_RED, GL_FLOAT, heights));
+	}
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void HeightTexture::allocate(int sizeX, int sizeY)
+{
+	if (sizeX == size_x_ && sizeY == size_y_)
+		return;
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, tex_));
+	CHECK_GL_ERROR(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F,
+				sizeY, sizeX, 0,
+				GL_RED, GL_FLOAT, nullptr));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, 0));
+	size_x_ = sizeX;
+	size_y_ = sizeY;
+}
+
+void HeightTexture::download(float* heights) const
+{
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, tex_));
+	CHECK_GL_ERROR(glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, heights));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+HeightVolumeTexture::HeightVolumeTexture()
+{
+	CHECK_GL_ERROR(glGenTextures(1, &tex_));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_3D, tex_));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	CHECK_GL_ERROR(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_3D, 0));
+}
+
+HeightVolumeTexture::~HeightVolumeTexture()
+{
+	CHECK_GL_ERROR(glDeleteTextures(1, &tex_));
+}
+
+namespace {
+
+void volumeFormat(const HeightVolume& volume, GLint& internal, GLenum& type)
+{
+	switch (volume.storage()) {
+	case HeightVolume::kFloat16:
+		internal = GL_R16F;
+		type = GL_HALF_FLOAT;
+		break;
+	case HeightVolume::kUint16:
+		internal = GL_R16;
+		type = GL_UNSIGNED_SHORT;
+		break;
+	default:
+		internal = GL_R32F;
+		type = GL_FLOAT;
+		break;
+	}
+}
+
+}
+
+void HeightVolumeTexture::reset(const HeightVolume& volume, int slices)
+{
+	GLint internal;
+	GLenum type;
+	volumeFormat(volume, internal, type);
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_3D, tex_));
+	CHECK_GL_ERROR(glTexImage3D(GL_TEXTURE_3D, 0, internal,
+				volume.sizeY(), volume.sizeX(), slices, 0,
+				GL_RED, type, nullptr));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_3D, 0));
+	uploaded_.assign(slices, false);
+	missing_ = slices;
+
+	// R16 is normalized, so the shader sees q / 65535.
+	if (volume.storage() == HeightVolume::kUint16) {
+		decode_[0] = volume.offset();
+		decode_[1] = volume.scale() * 65535.0f;
+	} else {
+		decode_[0] = 0.0f;
+		decode_[1] = 1.0f;
+	}
+}
+
+void HeightVolumeTexture::uploadSlice(const HeightVolume& volume, int z)
+{
+	GLint internal;
+	GLenum type;
+	volumeFormat(volume, internal, type);
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_3D, tex_));
+	// 16 bit rows of odd length are not 4 byte aligned.
+	CHECK_GL_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	CHECK_GL_ERROR(glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z,
+				volume.sizeY(), volume.sizeX(), 1,
+				GL_RED, type, volume.sliceData(z)));
+	CHECK_GL_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_3D, 0));
+	if (!uploaded_[z]) {
+		uploaded_[z] = true;
+		missing_--;
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef HEIGHT_TEXTURE_H
+#define HEIGHT_TEXTURE_H
+
+#include <vector>
+
+class HeightVolume;
+
+/*
+ * HeightTexture: one slice of a height map as a single channel float
+ * texture, sampled by shaders/terrain.vert to displace a flat grid.
+ *
+ * The slice layout matches HeightMap::readSlice (rows of x, each sizeY
+ * long), so texel (y, x) holds the height at grid point (x, y).
+ * Must be created after the GL context.
+ */
+class HeightTexture {
+public:
+	HeightTexture();
+	~HeightTexture();
+	HeightTexture(const HeightTexture&) = delete;
+	HeightTexture& operator=(const HeightTexture&) = delete;
+
+	/*
+	 * upload: copy sizeX * sizeY floats to the texture. Storage is only
+	 * reallocated when the dimensions change.
+	 */
+	void upload(const float* heights, int sizeX, int sizeY);
+	// Allocates storage for sizeX * sizeY heights, e.g. to render into.
+	void allocate(int sizeX, int sizeY);
+	// Reads the texture back into sizeX * sizeY floats.
+	void download(float* heights) const;
+	int sizeX() const { return size_x_; }
+	int sizeY() const { return size_y_; }
+	unsigned id() const { return tex_; }
+private:
+	unsigned tex_ = 0;
+	int size_x_ = 0, size_y_ = 0;
+};
+
+/*
+ * HeightVolumeTexture: the first slices of a HeightVolume as a 3D texture,
+ * so terrain.vert can animate by moving its sampling coordinate.
+ *
+ * Samples are uploaded in their storage format without conversion: R32F,
+ * R16F, or normalized R16 for kUint16, which decode() maps back to
+ * heights. Filtering is linear and wraps along z, so fractional levels
+ * blend neighbouring slices and the last slice blends into the first.
+ */
+class HeightVolumeTexture {
+public:
+	HeightVolumeTexture();
+	~HeightVolumeTexture();
+	HeightVolumeTexture(const HeightVolumeTexture&) = delete;
+	HeightVolumeTexture& operator=(const HeightVolumeTexture&) = delete;
+
+	/*
+	 * reset: reallocate the texture for the first slices z slices of
+	 * volume and mark every slice as missing.
+	 */
+	void reset(const HeightVolume& volume, int slices);
+	// Copies slice z of volume, which must have been generated.
+	void uploadSlice(const HeightVolume& volume, int z);
+	bool hasSlice(int z) const { return uploaded_[z]; }
+	bool complete() const { return missing_ == 0 && !uploaded_.empty(); }
+	int slices() const { return int(uploaded_.size()); }
+	unsigned id() const { return tex_; }
+	// (offset, unit): height = offset + unit * texel value.
+	const float* decode() const { return decode_; }
+private:
+	unsigned tex_ = 0;
+	std::vector<bool> uploaded_;
+	int missing_ = 0;
+	float decode_[2] = { 0.0f, 1.0f };
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "height_volume.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// IEEE 754 binary32 <-> binary16, round to nearest even.
+uint16_t floatToHalf(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t mag = x & 0x7FFFFFFF;
+
+	if (mag >= 0x7F800000) // Inf or NaN
+		return sign | 0x7C00 | (mag > 0x7F800000 ? 0x200 : 0);
+	if (mag >= 0x477FF000) // rounds to beyond the largest half
+		return sign | 0x7C00;
+	if (mag < 0x38800000) { // subnormal half or zero
+		if (mag < 0x33000000)
+			return sign;
+		uint32_t mant = (mag & 0x7FFFFF) | 0x800000;
+		int shift = 126 - (int)(mag >> 23);
+		uint32_t half = mant >> shift;
+		uint32_t rest = mant & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return sign | half;
+	}
+	uint32_t half = (mag - 0x38000000) >> 13;
+	uint32_t rest = mag & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return sign | half;
+}
+
+float halfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+	uint32_t x;
+	if (exp == 0x1F) {
+		x = sign | 0x7F800000 | (mant << 13);
+	} else if (exp != 0) {
+		x = sign | ((exp + 112) << 23) | (mant << 13);
+	} else if (mant == 0) {
+		x = sign;
+	} else {
+		// Subnormal half: normalize into a float.
+		exp = 113;
+		while (!(mant & 0x400)) {
+			mant <<= 1;
+			exp--;
+		}
+		x = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+}
+
+HeightVolume::HeightVolume(int sizeX, int sizeY, int sizeZ, Storage storage,
+                           float minValue, float maxValue)
+	: size_x_(sizeX), size_y_(sizeY), size_z_(sizeZ), storage_(storage),
+	offset_(minValue), scale_((maxValue - minValue) / 65535.0f)
+{
+	data_.reset(new uint8_t[bytes()]);
+}
+
+void HeightVolume::storeSlice(int z, const float* values)
+{
+	size_t n = sliceSamples();
+	uint8_t* dst = data_.get() + z * n * sampleSize();
+	if (storage_ == kFloat32) {
+		memcpy(dst, values, n * sizeof(float));
+	} else if (storage_ == kFloat16) {
+		uint16_t* out = (uint16_t*)dst;
+		for (size_t i = 0; i < n; i++)
+			out[i] = floatToHalf(values[i]);
+	} else {
+		uint16_t* out = (uint16_t*)dst;
+		float inv = scale_ > 0.0f ? 1.0f / scale_ : 0.0f;
+		for (size_t i = 0; i < n; i++) {
+			float q = (values[i] - offset_) * inv + 0.5f;
+			out[i] = (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+		}
+	}
+}
+
+void HeightVolume::loadSlice(int z, float* out) const
+{
+	size_t n = sliceSamples();
+	size_t base = z * n;
+	if (storage_ == kFloat32) {
+		memcpy(out, data_.get() + base * sizeof(float), n * sizeof(float));
+		return;
+	}
+	for (size_t i = 0; i < n; i++)
+		out[i] = decode(base + i);
+}
+
+float HeightVolume::at(int x, int y, int z) const
+{
+	return decode(z * sliceSamples() + (size_t)x * size_y_ + y);
+}
+
+const void* HeightVolume::sliceData(int z) const
+{
+	return data_.get() + z * sliceSamples() * sampleSize();
+}
+
+float HeightVolume::decode(size_t i) const
+{
+	if (storage_ == kFloat32)
+		return ((const float*)data_.get())[i];
+	uint16_t v = ((const uint16_t*)data_.get())[i];
+	if (storage_ == kFloat16)
+		return halfToFloat(v);
+	return offset_ + v * scale_;
+}
+
+bool HeightVolume::parseStorage(const char* name, Storage& storage)
+{
+	if (strcmp(name, "float") == 0)
+		storage = kFloat32;
+	else if (strcmp(name, "half") == 0)
+		storage = kFloat16;
+	else if (strcmp(name, "uint16") == 0)
+		storage = kUint16;
+	else
+		return false;
+	return true;
+}
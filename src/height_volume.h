@@ -0,0 +1,60 @@
+#ifndef HEIGHT_VOLUME_H
+#define HEIGHT_VOLUME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * HeightVolume: sizeX x sizeY x sizeZ heights with runtime dimensions and
+ * a selectable storage format.
+ *
+ * Slices along z are contiguous (rows of x, each sizeY long), which is
+ * the order generateTerrain reads one animation level in.
+ *
+ *      kFloat32: 4 bytes per sample, exact
+ *      kFloat16: 2 bytes per sample, IEEE half (11 significant bits)
+ *      kUint16:  2 bytes per sample, value = offset + q * scale with q in
+ *                [0, 65535] spanning [minValue, maxValue]; values outside
+ *                the range are clamped
+ *
+ * Storage is allocated uninitialized so untouched slices cost no memory.
+ */
+class HeightVolume {
+public:
+	enum Storage { kFloat32, kFloat16, kUint16 };
+
+	HeightVolume(int sizeX, int sizeY, int sizeZ, Storage storage,
+	             float minValue = 0.0f, float maxValue = 1.0f);
+
+	int sizeX() const { return size_x_; }
+	int sizeY() const { return size_y_; }
+	int sizeZ() const { return size_z_; }
+	Storage storage() const { return storage_; }
+	size_t sampleSize() const { return storage_ == kFloat32 ? 4 : 2; }
+	size_t sliceSamples() const { return (size_t)size_x_ * size_y_; }
+	size_t bytes() const { return sliceSamples() * size_z_ * sampleSize(); }
+	// kUint16 decoding: value = offset() + q * scale().
+	float offset() const { return offset_; }
+	float scale() const { return scale_; }
+
+	// Encodes sliceSamples() floats into slice z.
+	void storeSlice(int z, const float* values);
+	// Decodes slice z into sliceSamples() floats.
+	void loadSlice(int z, float* out) const;
+	float at(int x, int y, int z) const;
+	// Encoded bytes of slice z, e.g. for texture upload.
+	const void* sliceData(int z) const;
+
+	// Parses "float", "half" or "uint16"; returns false if unknown.
+	static bool parseStorage(const char* name, Storage& storage);
+private:
+	float decode(size_t i) const;
+
+	int size_x_, size_y_, size_z_;
+	Storage storage_;
+	float offset_, scale_;
+	std::unique_ptr<uint8_t[]> data_;
+};
+
+#endif
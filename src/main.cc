@@ -2,14 +2,23 @@
 #include <dirent.h>
 
 #include "procedure_geometry.h"
+#include "program_cache.h"
 #include "render_pass.h"
 #include "config.h"
+#include "frustum.h"
+#include "gpu_perlin.h"
+#include "gpu_timer.h"
 #include "gui.h"
-#include "perlin.h"
+#include "height_texture.h"
+#include "terrain_generator.h"
+#include "terrain_lod.h"
+#include "terrain_stream.h"
+#include "uniform_block.h"
 
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -40,136 +49,220 @@ const char* floor_fragment_shader =
 #include "shaders/floor.frag"
 ;
 
+const char* terrain_vertex_shader =
+#include "shaders/terrain.vert"
+;
+
+const char* terrain_mesh_vertex_shader =
+#include "shaders/terrain_mesh.vert"
+;
+
 // FIXME: Add more shaders here.
 
+// The PerFrame uniform block of the shaders, in std140 layout.
+struct PerFrame {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec4 light_position;
+	glm::vec3 camera_position;
+	float pad;
+};
+
 void ErrorCallback(int error, const char* description) {
 	std::cerr << "GLFW Error: " << description << "\n";
 }
 
-// Height map variables
-const int mapSizeX = 128;
-const int mapSizeZ = 128;
-const int mapSizeY = 128;
+TerrainGenerator generator;
 double heightScale = 3.0;
-double noiseScale = 0.05;
-double heightMap[mapSizeX][mapSizeZ][mapSizeY];
-
-void generateHeightMap(int type, GUI& gui)
+// Volume edge length and sample format, set with --size and --storage.
+int mapSize = 128;
+HeightVolume::Storage mapStorage = HeightVolume::kFloat32;
+// The animation loops over the first animationSlices z slices.
+int animationSlices = 64;
+// Slices generated ahead of the one the animation is showing.
+const int prefetchSlices = 4;
+// Render the GPU height slice mode's noise with GpuPerlin (--gpu-noise).
+bool gpuNoise = false;
+// Compare GpuPerlin with the CPU generator and exit (--check-gpu-noise).
+// The window is hidden, so the check can run under xvfb-run.
+bool checkNoise = false;
+// Report GL errors through a KHR_debug callback instead of glGetError
+// (--gl-debug).
+bool glDebugCallback = false;
+// Noise seed to start with (--seed); N steps to the next one.
+unsigned startSeed = 0;
+// Grid points after which map type 1 repeats (--period), 0 for never.
+int mapPeriod = 0;
+
+// Snapshot of the GUI state generation depends on. Only map type 1 sets
+// the height scale; the others keep the last one requested.
+HeightMapParams heightMapParams(GUI& gui)
 {
-	bool octaveNoise = gui.useOctaves();
-	int numOctaves = gui.numOctaves();
-	double persistence = gui.getPersistence();
-	// Perlin noise
-	if(type == 1)
-	{
+	if(gui.getMapType() == 1)
 		heightScale = gui.getHeight();
-		Perlin noise;
-		for(int x = 0; x < mapSizeX; ++x)
-		{
-			for(int y = 0; y < mapSizeY; ++y)
-			{
-				for(int z = 0; z < mapSizeZ; ++z)
-				{
-					double n;
-					if(octaveNoise)
-						n = noise.OctavePerlin(noiseScale * x, noiseScale * y, noiseScale * z, numOctaves, persistence);
-					else
-						n = noise.perlin(noiseScale * x, noiseScale * y, noiseScale * z);
-					heightMap[x][y][z] = heightScale * n;
-				}
-			}
-		}
-	}
-	else if(type == 2)
-	{
-		Perlin noise;
-		double xPeriod = 5.0;
-		double yPeriod = 5.0;
-		double power = gui.getSinPow();
-		for(int x = 0; x < mapSizeX; ++x)
-		{
-			for(int y = 0; y < mapSizeY; ++y)
-			{
-				for(int z = 0; z < mapSizeZ; ++z)
-				{
-					double n;
-					if(octaveNoise)
-						n = noise.OctavePerlin(noiseScale * x, noiseScale * y, noiseScale * z, numOctaves, persistence);
-					else
-						n = noise.perlin(noiseScale * x, noiseScale * y, noiseScale * z);
-					double val = x * xPeriod / mapSizeX + y * yPeriod / mapSizeY + power * n;
-					heightMap[x][y][z] = heightScale * fabs(sin(val * 3.14159));
-				}
-			}
-		}
-	}
-	else if(type == 3)
+
+	HeightMapParams params;
+	params.sizeX = params.sizeY = params.sizeZ = mapSize;
+	params.storage = mapStorage;
+	params.type = gui.getMapType();
+	params.octaves = gui.useOctaves();
+	params.numOctaves = gui.numOctaves();
+	params.persistence = gui.getPersistence();
+	params.heightScale = heightScale;
+	params.seed = gui.getSeed();
+	params.period = mapPeriod;
+	if(params.type == 2)
+		params.power = gui.getSinPow();
+	else if(params.type == 3)
+		params.power = gui.getRingPow();
+	return params;
+}
+
+// Terrain variables
+double minX = 0.0;
+double maxX = 10.0;
+double minZ = 0.0;
+double maxZ = 10.0;
+
+// Builds the triangle list of the terrain grid. The topology only depends
+// on the map size, so this runs once. Triangles are grouped by
+// HeightMap chunk, cx major, so chunk i is the triangles from
+// chunkFirst[i] to chunkFirst[i + 1] and can be culled on its own.
+void generateTerrainIndices(vector<glm::uvec3>& indices, vector<size_t>& chunkFirst)
+{
+	// Terrain x and z run along the volume's x and y axes.
+	int mapSizeX = mapSize;
+	int mapSizeZ = mapSize;
+	int chunksX = (mapSizeX - 2) / chunkQuads + 1;
+	int chunksZ = (mapSizeZ - 2) / chunkQuads + 1;
+	indices.clear();
+	indices.reserve(2 * (mapSizeX - 1) * (mapSizeZ - 1));
+	chunkFirst.clear();
+	for(int cx = 0; cx < chunksX; ++cx)
 	{
-		Perlin noise;
-		double period = 5.0;
-		double power = gui.getRingPow();
-		for(int x = 0; x < mapSizeX; ++x)
+		for(int cz = 0; cz < chunksZ; ++cz)
 		{
-			for(int y = 0; y < mapSizeY; ++y)
+			chunkFirst.push_back(indices.size());
+			int xEnd = std::min((cx + 1) * chunkQuads, mapSizeX - 1);
+			int zEnd = std::min((cz + 1) * chunkQuads, mapSizeZ - 1);
+			for(int x = cx * chunkQuads; x < xEnd; ++x)
 			{
-				for(int z = 0; z < mapSizeZ; ++z)
+				for(int z = cz * chunkQuads; z < zEnd; ++z)
 				{
-					double n;
-					if(octaveNoise)
-						n = noise.OctavePerlin(noiseScale * x, noiseScale * y, noiseScale * z, numOctaves, persistence);
-					else
-						n = noise.perlin(noiseScale * x, noiseScale * y, noiseScale * z);
-					double xVal = (x - mapSizeX / 2) / (double)mapSizeX;
-					double yVal = (y - mapSizeY / 2) / (double)mapSizeY;
-					double dist = sqrt(xVal * xVal + yVal * yVal) + power * n;
-					heightMap[x][y][z] = heightScale * fabs(sin(2 * period * dist * 3.14159));
+					int v1 = z + x * mapSizeX;
+					int v2 = z + x * mapSizeX + 1;
+					int v3 = z + (x + 1) * mapSizeX;
+					int v4 = z + (x + 1) * mapSizeX + 1;
+
+					indices.push_back(glm::uvec3(v1, v2, v3));
+					indices.push_back(glm::uvec3(v4, v3, v2));
 				}
 			}
 		}
 	}
+	chunkFirst.push_back(indices.size());
 }
 
-// Terrain variables
-double minX = 0.0;
-double maxX = 10.0;
-double dX = (maxX - minX) / (mapSizeX - 1);
-double minZ = 0.0;
-double maxZ = 10.0;
-double dZ = (maxZ - minZ) / (mapSizeZ - 1);
-
-void generateTerrain(vector<glm::vec4>& vertices, vector<glm::uvec3>& indices, vector<glm::vec4>& colors, int level)
+// Writes the position, normal and color of every terrain vertex for one
+// slice of the current height map. The vectors are sized once and then
+// overwritten in place, so their data pointers stay valid for RenderPass.
+// Normals come from the noise's analytic gradient, see
+// HeightMap::readGradient.
+void generateTerrain(vector<glm::vec4>& vertices, vector<glm::vec4>& normals,
+		vector<glm::vec4>& colors, int level)
 {
+	HeightMap& heightMap = generator.front();
+	double heightScale = heightMap.params().heightScale;
+	int mapSizeX = heightMap.params().sizeX;
+	int mapSizeZ = heightMap.params().sizeY;
+	double dX = (maxX - minX) / (mapSizeX - 1);
+	double dZ = (maxZ - minZ) / (mapSizeZ - 1);
+	std::vector<float> slice(heightMap.volume().sliceSamples());
+	heightMap.readSlice(level, slice.data());
+	std::vector<float> slopes(2 * slice.size());
+	heightMap.readGradient(level, slopes.data());
+
+	vertices.resize(mapSizeX * mapSizeZ);
+	normals.resize(mapSizeX * mapSizeZ);
+	colors.resize(mapSizeX * mapSizeZ);
 	for(int x = 0; x < mapSizeX; ++x)
 	{
 		for(int z = 0; z < mapSizeZ; ++z)
 		{
+			int i = x * mapSizeZ + z;
 			double posX = minX + x * dX;
 			double posZ = minZ + z * dZ;
-			double posY = heightMap[x][z][level];
+			double posY = slice[i];
 
-			vertices.push_back(glm::vec4(posX, posY, posZ, 1.0));
+			vertices[i] = glm::vec4(posX, posY, posZ, 1.0);
+			double dY_dX = slopes[2 * i] / dX;
+			double dY_dZ = slopes[2 * i + 1] / dZ;
+			normals[i] = glm::vec4(glm::normalize(glm::vec3(-dY_dX, 1.0, -dY_dZ)), 0.0);
 			if(posY >= 0.7 * heightScale)
-				colors.push_back(glm::vec4(1.0, 1.0, 1.0, 1.0));
+				colors[i] = glm::vec4(1.0, 1.0, 1.0, 1.0);
 			else if(posY >= 0.45 * heightScale)
-				colors.push_back(glm::vec4(0.2, 0.1, 0.0, 1.0));
+				colors[i] = glm::vec4(0.2, 0.1, 0.0, 1.0);
 			else
-				colors.push_back(glm::vec4(0.0, 1.0, 0.0, 1.0));
+				colors[i] = glm::vec4(0.0, 1.0, 0.0, 1.0);
 		}
 	}
+}
 
-	for(int x = 0; x < mapSizeX - 1; ++x)
+// Uploads one slice of the current height map for terrain.vert.
+void uploadHeightSlice(HeightTexture& texture, int level)
+{
+	HeightMap& heightMap = generator.front();
+	std::vector<float> slice(heightMap.volume().sliceSamples());
+	heightMap.readSlice(level, slice.data());
+	texture.upload(slice.data(), heightMap.params().sizeX, heightMap.params().sizeY);
+}
+
+// --check-gpu-noise: compares GpuPerlin with the CPU generator for every
+// map type, with and without octaves, using the --seed table. Returns the
+// process exit status.
+int checkGpuNoise()
+{
+	// float rounding of the map type transforms dominates; see GpuPerlin.
+	const double tolerance = 1e-4;
+	GpuPerlin gpu;
+	HeightTexture texture;
+	int failures = 0;
+	for(int type = 1; type <= 3; ++type)
 	{
-		for(int z = 0; z < mapSizeZ - 1; ++z)
+		for(int octaves = 0; octaves < 2; ++octaves)
 		{
-			int v1 = x + z * mapSizeX;
-			int v2 = x + z * mapSizeX + 1;
-			int v3 = x + (z + 1) * mapSizeX;
-			int v4 = x + (z + 1) * mapSizeX + 1;
-
-			indices.push_back(glm::uvec3(v1, v2, v3));
-			indices.push_back(glm::uvec3(v4, v3, v2));
+			HeightMapParams params;
+			params.sizeX = params.sizeY = params.sizeZ = mapSize;
+			params.type = type;
+			params.octaves = octaves;
+			params.numOctaves = 5;
+			params.persistence = 0.5;
+			params.power = type == 1 ? 0.0 : 2.5;
+			params.seed = startSeed;
+			params.period = mapPeriod;
+			HeightMap heightMap(params, generator.threadCount());
+			std::vector<float> cpu(heightMap.volume().sliceSamples());
+			std::vector<float> gpuHeights(cpu.size());
+
+			int slices[] = { 0, mapSize / 2, mapSize - 1 };
+			for(int z : slices)
+			{
+				heightMap.readSlice(z, cpu.data());
+				gpu.render(params, z, texture);
+				texture.download(gpuHeights.data());
+				double maxError = 0.0;
+				for(size_t i = 0; i < cpu.size(); ++i)
+					maxError = std::max(maxError, (double)fabs(cpu[i] - gpuHeights[i]));
+				bool ok = maxError <= tolerance * params.heightScale;
+				failures += !ok;
+				std::cout << "type " << type << (octaves ? " octaves" : "        ")
+				          << " slice " << z << ": max error " << maxError
+				          << (ok ? "" : "  FAILED") << "\n";
+			}
 		}
 	}
+	std::cout << (failures ? "GPU noise check failed" : "GPU noise matches the CPU reference") << std::endl;
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 GLFWwindow* init_glefw()
@@ -182,12 +275,19 @@ GLFWwindow* init_glefw()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_SAMPLES, 4);
+	if (checkNoise)
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	// Some drivers only send debug messages to debug contexts.
+	if (glDebugCallback)
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 	auto ret = glfwCreateWindow(window_width, window_height, window_title.data(), nullptr, nullptr);
 	CHECK_SUCCESS(ret != nullptr);
 	glfwMakeContextCurrent(ret);
 	glewExperimental = GL_TRUE;
 	CHECK_SUCCESS(glewInit() == GLEW_OK);
 	glGetError();  // clear GLEW's error for it
+	if (glDebugCallback && !debugglUseCallback())
+		std::cerr << "KHR_debug is not supported, checking glGetError instead\n";
 	glfwSwapInterval(1);
 	const GLubyte* renderer = glGetString(GL_RENDERER);  // get renderer string
 	const GLubyte* version = glGetString(GL_VERSION);    // version as a string
@@ -204,20 +304,92 @@ int main(int argc, char* argv[])
 	// 	std::cerr << "Usage: " << argv[0] << " <PMD file>" << std::endl;
 	// 	return -1;
 	// }
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc) {
+			generator.setThreads(std::max(0, atoi(argv[++i])));
+		} else if (arg == "--size" && i + 1 < argc) {
+			mapSize = std::max(2, atoi(argv[++i]));
+		} else if (arg == "--seed" && i + 1 < argc) {
+			startSeed = strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--period" && i + 1 < argc) {
+			mapPeriod = std::max(0, atoi(argv[++i]));
+		} else if (arg == "--shader-cache" && i + 1 < argc) {
+			ProgramCache::setDirectory(argv[++i]);
+		} else if (arg == "--gpu-timers") {
+			GpuTimer::setEnabled(true);
+		} else if (arg == "--gpu-timers-csv" && i + 1 < argc) {
+			GpuTimer::setCsv(argv[++i]);
+		} else if (arg == "--gl-debug") {
+			glDebugCallback = true;
+		} else if (arg == "--gpu-noise") {
+			gpuNoise = true;
+		} else if (arg == "--check-gpu-noise") {
+			checkNoise = true;
+		} else if (arg == "--storage" && i + 1 < argc &&
+		           HeightVolume::parseStorage(argv[i + 1], mapStorage)) {
+			i++;
+		} else {
+			std::cerr << "Usage: " << argv[0]
+			          << " [--threads N] [--size N] [--storage float|half|uint16] [--seed N]"
+			          << " [--period N] [--shader-cache DIR]"
+			          << " [--gpu-timers] [--gpu-timers-csv FILE] [--gl-debug]"
+			          << " [--gpu-noise] [--check-gpu-noise]"
+			          << std::endl;
+			return -1;
+		}
+	}
+	animationSlices = std::min(animationSlices, mapSize);
+	std::cout << "Generating terrain with " << generator.threadCount() << " thread(s)\n";
 	GLFWwindow *window = init_glefw();
+	if (checkNoise) {
+		int status = checkGpuNoise();
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return status;
+	}
 
 	GUI gui(window);
+	gui.setSeed(startSeed);
 
 	std::vector<glm::vec4> floor_vertices;
 	std::vector<glm::uvec3> floor_faces;
+	std::vector<glm::vec4> floor_normals;
 	std::vector<glm::vec4> floor_colors;
 	//create_floor(floor_vertices, floor_faces);
 
 	// FIXME: add code to create terrain geometry
 	int level = 1;
 
-	generateHeightMap(1, gui);
-	generateTerrain(floor_vertices, floor_faces, floor_colors, 0);
+	generator.request(heightMapParams(gui));
+	generator.wait();
+	generator.swap();
+	std::vector<size_t> chunk_first;
+	generateTerrainIndices(floor_faces, chunk_first);
+	generateTerrain(floor_vertices, floor_normals, floor_colors, 0);
+
+	// GPU path: a static grid displaced by terrain.vert, drawn either as
+	// one full resolution node or as TerrainLod patches.
+	std::vector<glm::vec4> grid_vertices;
+	std::vector<glm::uvec3> grid_patch_faces;
+	// Same layout as the CPU mesh, so it reuses its chunked indices.
+	TerrainLod::buildPatch(mapSize, false, grid_vertices, grid_patch_faces);
+	TerrainLod terrain_lod(minX, minZ, maxX - minX, mapSize);
+	std::vector<LodNode> lod_nodes;
+	glm::vec4 terrain_node(minX, minZ, maxX - minX, 0.0f);
+	HeightTexture height_texture;
+	float terrain_height_scale = generator.front().params().heightScale;
+	std::unique_ptr<GpuPerlin> gpu_perlin;
+	HeightMapParams gpu_noise_params = heightMapParams(gui);
+	if(gpuNoise)
+		gpu_perlin.reset(new GpuPerlin);
+	// Volume mode: the animated slices as one 3D texture, filled as the
+	// generator finishes them and sampled at a fractional level.
+	HeightVolumeTexture volume_texture;
+	bool volumeStale = true;
+	int lastTerrainMode = 0;
+	int use_volume = 0;
+	float volume_level = 0.0f;
 
 	glm::vec4 light_position = glm::vec4(5.0f, 10.0f, 5.0f, 1.0f);
 	MatrixPointers mats; // Define MatrixPointers here for lambda to capture
@@ -234,9 +406,6 @@ int main(int argc, char* argv[])
 	auto vector_binder = [](int loc, const void* data) {
 		glUniform4fv(loc, 1, (const GLfloat*)data);
 	};
-	auto vector3_binder = [](int loc, const void* data) {
-		glUniform3fv(loc, 1, (const GLfloat*)data);
-	};
 	auto float_binder = [](int loc, const void* data) {
 		glUniform1fv(loc, 1, (const GLfloat*)data);
 	};
@@ -250,17 +419,55 @@ int main(int argc, char* argv[])
 	auto floor_model_data = [&floor_model_matrix]() -> const void* {
 		return &floor_model_matrix[0][0];
 	}; // This return model matrix for the floor.
-	auto std_view_data = [&mats]() -> const void* {
-		return mats.view;
+	glm::mat4 stream_model_matrix = glm::mat4(1.0f);
+	auto stream_model_data = [&stream_model_matrix]() -> const void* {
+		return &stream_model_matrix[0][0];
+	}; // Places the streamed tile being drawn.
+	auto texture0_binder = [](int loc, const void* data) {
+		glUniform1i(loc, 0);
+		glActiveTexture(GL_TEXTURE0 + 0);
+		glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)data);
+	};
+	auto height_map_data = [&height_texture]() -> const void* {
+		return (const void*)(intptr_t)height_texture.id();
+	};
+	auto height_scale_data = [&terrain_height_scale]() -> const void* {
+		return &terrain_height_scale;
+	};
+	auto int_binder = [](int loc, const void* data) {
+		glUniform1iv(loc, 1, (const GLint*)data);
 	};
-	auto std_camera_data  = [&gui]() -> const void* {
-		return &gui.getCamera()[0];
+	auto vector2_binder = [](int loc, const void* data) {
+		glUniform2fv(loc, 1, (const GLfloat*)data);
 	};
-	auto std_proj_data = [&mats]() -> const void* {
-		return mats.projection;
+	auto texture1_3d_binder = [](int loc, const void* data) {
+		glUniform1i(loc, 1);
+		glActiveTexture(GL_TEXTURE0 + 1);
+		glBindTexture(GL_TEXTURE_3D, (GLuint)(intptr_t)data);
+		glActiveTexture(GL_TEXTURE0 + 0);
 	};
-	auto std_light_data = [&light_position]() -> const void* {
-		return &light_position[0];
+	auto height_volume_data = [&volume_texture]() -> const void* {
+		return (const void*)(intptr_t)volume_texture.id();
+	};
+	auto use_volume_data = [&use_volume]() -> const void* {
+		return &use_volume;
+	};
+	auto volume_level_data = [&volume_level]() -> const void* {
+		return &volume_level;
+	};
+	auto height_decode_data = [&volume_texture]() -> const void* {
+		return volume_texture.decode();
+	};
+	glm::vec2 grid_spacing((maxX - minX) / (mapSize - 1), (maxZ - minZ) / (mapSize - 1));
+	auto grid_spacing_data = [&grid_spacing]() -> const void* {
+		return &grid_spacing[0];
+	};
+	glm::vec2 terrain_origin(minX, minZ);
+	auto terrain_origin_data = [&terrain_origin]() -> const void* {
+		return &terrain_origin[0];
+	};
+	auto terrain_node_data = [&terrain_node]() -> const void* {
+		return &terrain_node[0];
 	};
 	auto alpha_data  = [&gui]() -> const void* {
 		static const float transparet = 0.5; // Alpha constant goes here
@@ -272,13 +479,25 @@ int main(int argc, char* argv[])
 	};
 	// FIXME: add more lambdas for data_source if you want to use RenderPass.
 	//        Otherwise, do whatever you like here
-	ShaderUniform std_model = { "model", matrix_binder, std_model_data };
-	ShaderUniform floor_model = { "model", matrix_binder, floor_model_data };
-	ShaderUniform std_view = { "view", matrix_binder, std_view_data };
-	ShaderUniform std_camera = { "camera_position", vector3_binder, std_camera_data };
-	ShaderUniform std_proj = { "projection", matrix_binder, std_proj_data };
-	ShaderUniform std_light = { "light_position", vector_binder, std_light_data };
-	ShaderUniform object_alpha = { "alpha", float_binder, alpha_data };
+	// Sizes let RenderPass skip values that did not change; the texture
+	// binders have none, since they bind texture units too.
+	ShaderUniform std_model = { "model", matrix_binder, std_model_data, sizeof(glm::mat4) };
+	ShaderUniform floor_model = { "model", matrix_binder, floor_model_data, sizeof(glm::mat4) };
+	ShaderUniform stream_model = { "model", matrix_binder, stream_model_data, sizeof(glm::mat4) };
+	ShaderUniform object_alpha = { "alpha", float_binder, alpha_data, sizeof(float) };
+	ShaderUniform terrain_height_map = { "height_map", texture0_binder, height_map_data };
+	ShaderUniform terrain_height_scale_uniform = { "height_scale", float_binder, height_scale_data, sizeof(float) };
+	ShaderUniform terrain_height_volume = { "height_volume", texture1_3d_binder, height_volume_data };
+	ShaderUniform terrain_use_volume = { "use_volume", int_binder, use_volume_data, sizeof(int) };
+	ShaderUniform terrain_level = { "level", float_binder, volume_level_data, sizeof(float) };
+	ShaderUniform terrain_height_decode = { "height_decode", vector2_binder, height_decode_data, sizeof(glm::vec2) };
+	ShaderUniform terrain_grid_spacing = { "grid_spacing", vector2_binder, grid_spacing_data, sizeof(glm::vec2) };
+	ShaderUniform terrain_origin_uniform = { "terrain_origin", vector2_binder, terrain_origin_data, sizeof(glm::vec2) };
+	ShaderUniform terrain_node_uniform = { "node", vector_binder, terrain_node_data, sizeof(glm::vec4) };
+	// View, projection, light and camera are the same for every pass, so
+	// they go to the PerFrame block once a frame.
+	PerFrame per_frame;
+	UniformBlock per_frame_block("PerFrame", sizeof(PerFrame));
 	// FIXME: define more ShaderUniforms for RenderPass if you want to use it.
 	//        Otherwise, do whatever you like here
 
@@ -296,9 +515,7 @@ int main(int argc, char* argv[])
 	// 		  geometry_shader,
 	// 		  fragment_shader
 	// 		},
-	// 		{ std_model, std_view, std_proj,
-	// 		  std_light,
-	// 		  std_camera, object_alpha },
+	// 		{ std_model, object_alpha },
 	// 		{ "fragment_color" }
 	// 		);
 
@@ -307,14 +524,58 @@ int main(int argc, char* argv[])
 
 	RenderDataInput floor_pass_input;
 	floor_pass_input.assign(0, "vertex_position", floor_vertices.data(), floor_vertices.size(), 4, GL_FLOAT);
+	floor_pass_input.assign(1, "normal", floor_normals.data(), floor_normals.size(), 4, GL_FLOAT);
 	floor_pass_input.assign(3, "color", floor_colors.data(), floor_colors.size(), 4, GL_FLOAT);
 	floor_pass_input.assign_index(floor_faces.data(), floor_faces.size(), 3);
 	RenderPass floor_pass(-1,
 			floor_pass_input,
-			{ vertex_shader, geometry_shader, floor_fragment_shader},
-			{ floor_model, std_view, std_proj, std_light },
+			{ terrain_mesh_vertex_shader, nullptr, floor_fragment_shader },
+			{ floor_model },
+			{ "fragment_color" }
+			);
+	floor_pass.setName("terrain mesh");
+
+	std::vector<ShaderUniform> terrain_uniforms = {
+		floor_model,
+		terrain_height_map, terrain_height_scale_uniform,
+		terrain_height_volume, terrain_use_volume,
+		terrain_level, terrain_height_decode, terrain_grid_spacing,
+		terrain_origin_uniform, terrain_node_uniform };
+	RenderDataInput terrain_pass_input;
+	terrain_pass_input.assign(0, "vertex_position", grid_vertices.data(), grid_vertices.size(), 4, GL_FLOAT);
+	terrain_pass_input.assign_index(floor_faces.data(), floor_faces.size(), 3);
+	RenderPass terrain_pass(-1,
+			terrain_pass_input,
+			{ terrain_vertex_shader, nullptr, floor_fragment_shader },
+			terrain_uniforms,
+			{ "fragment_color" }
+			);
+	terrain_pass.setName("terrain gpu");
+
+	RenderDataInput lod_pass_input;
+	lod_pass_input.assign(0, "vertex_position", terrain_lod.patchVertices().data(),
+			terrain_lod.patchVertices().size(), 4, GL_FLOAT);
+	lod_pass_input.assign_index(terrain_lod.patchFaces().data(), terrain_lod.patchFaces().size(), 3);
+	RenderPass lod_pass(-1,
+			lod_pass_input,
+			{ terrain_vertex_shader, nullptr, floor_fragment_shader },
+			terrain_uniforms,
 			{ "fragment_color" }
 			);
+	lod_pass.setName("terrain lod");
+	// Streamed mode: every tile mesh sits in a fixed slot of one pool
+	// buffer per attribute, drawn with the shared tile index buffer.
+	// Created on first use.
+	std::unique_ptr<TerrainStream> terrain_stream;
+	std::unique_ptr<RenderPass> stream_pass;
+	std::vector<glm::vec4> stream_tile_vertices;
+	std::vector<glm::uvec3> stream_tile_faces;
+	TerrainLod::buildPatch(kStreamTileQuads + 1, false, stream_tile_vertices, stream_tile_faces);
+	bool streamStale = true;
+
+	// Slice and terrain mode currently on screen.
+	int shownLevel = 0;
+	int shownMode = 0;
 	float aspect = 0.0f;
 
 	bool draw_floor = true;
@@ -337,53 +598,250 @@ int main(int argc, char* argv[])
 
 		gui.updateMatrices();
 		mats = gui.getMatrixPointers();
+		per_frame.projection = gui.getProjectionMatrix();
+		per_frame.view = gui.getViewMatrix();
+		per_frame.light_position = light_position;
+		per_frame.camera_position = gui.getCamera();
+		per_frame_block.update(&per_frame);
 		bool advanceFrame = gui.advanceFrame();
 		bool dirty = gui.isDirty();
+		bool reload = false;
 
 		if(dirty)
 		{
 			gui.setClean();
 			gui.stopAdvance();
 
-			generateHeightMap(gui.getMapType(), gui);
-
-			floor_vertices.clear();
-			floor_faces.clear();
-			floor_colors.clear();
-
-			generateTerrain(floor_vertices, floor_faces, floor_colors, 0);
-			floor_pass.updateVBO(0, floor_vertices.data(), floor_vertices.size());
-			floor_pass.updateVBO(3, floor_colors.data(), floor_colors.size());
-			floor_pass = RenderPass(floor_pass.getVAO(),
-					floor_pass_input,
-					{ vertex_shader, geometry_shader, floor_fragment_shader },
-					{ floor_model, std_view, std_proj, std_light },
-					{ "fragment_color "}
-					);
+			// Keep drawing the current terrain; the new one is swapped in
+			// once the background generator has finished it.
+			generator.request(heightMapParams(gui));
+			// The GPU generates a slice within the frame.
+			gpu_noise_params = heightMapParams(gui);
+			reload = true;
+		}
+
+		// Only the active path is kept up to date; switching modes
+		// reloads the slice on screen.
+		int showLevel = shownLevel;
+		int terrainMode = gui.getTerrainMode();
+		bool gpuTerrain = terrainMode == 1 || terrainMode == 2;
+		bool streamTerrain = terrainMode == 3;
+		if(terrainMode != shownMode)
+			reload = true;
+
+		if(generator.swap())
+		{
+			showLevel = 0;
+			reload = true;
+			volumeStale = true;
+			streamStale = true;
+			volume_level = 0.0f;
+			terrain_height_scale = generator.front().params().heightScale;
 		}
 
-		if(advanceFrame)
+		// Volume mode draws from the 3D texture once every animated slice
+		// is resident and uses the slice path until then.
+		if(terrainMode == 2)
 		{
-			if(level > 63)
+			HeightMap& heightMap = generator.front();
+			if(volumeStale)
+				volume_texture.reset(heightMap.volume(), animationSlices);
+			// Other modes replace the prefetch list, so reissue it on entry.
+			if(volumeStale || lastTerrainMode != 2)
+			{
+				std::vector<int> missing;
+				for(int z = 0; z < animationSlices; ++z)
+					if(!heightMap.hasSlice(z))
+						missing.push_back(z);
+				generator.prefetch(missing);
+				volumeStale = false;
+			}
+			for(int z = 0; z < volume_texture.slices(); ++z)
+				if(!volume_texture.hasSlice(z) && heightMap.hasSlice(z))
+					volume_texture.uploadSlice(heightMap.volume(), z);
+		}
+		use_volume = terrainMode == 2 && volume_texture.complete();
+		lastTerrainMode = terrainMode;
+
+		if(advanceFrame && use_volume)
+		{
+			// A uniform update per frame; the hardware blends slices.
+			volume_level += gui.getPlaybackSpeed();
+			if(volume_level >= animationSlices)
+				volume_level -= animationSlices;
+		}
+		else if(advanceFrame)
+		{
+			if(level >= animationSlices)
 				level = 0;
 
-			floor_vertices.clear();
-			floor_faces.clear();
-			floor_colors.clear();
+			showLevel = level;
+			// Volume mode is loading every slice already and streamed
+			// mode only shows the first.
+			if(terrainMode < 2)
+			{
+				std::vector<int> ahead;
+				for(int i = 1; i <= prefetchSlices; ++i)
+					ahead.push_back((level + i) % animationSlices);
+				generator.prefetch(ahead);
+			}
+		}
 
-			generateTerrain(floor_vertices, floor_faces, floor_colors, level);
-			floor_pass.updateVBO(0, floor_vertices.data(), floor_vertices.size());
-			floor_pass = RenderPass(floor_pass.getVAO(),
-					floor_pass_input,
-					{ vertex_shader, geometry_shader, floor_fragment_shader },
-					{ floor_model, std_view, std_proj, std_light },
-					{ "fragment_color "}
-					);
+		if(!use_volume && !streamTerrain && (reload || showLevel != shownLevel))
+		{
+			if(gpu_perlin && terrainMode == 1)
+			{
+				gpu_perlin->render(gpu_noise_params, showLevel, height_texture);
+				terrain_height_scale = gpu_noise_params.heightScale;
+			}
+			else if(gpuTerrain)
+			{
+				uploadHeightSlice(height_texture, showLevel);
+			}
+			else
+			{
+				generateTerrain(floor_vertices, floor_normals, floor_colors, showLevel);
+				floor_pass.updateVBO(0, floor_vertices.data(), floor_vertices.size());
+				floor_pass.updateVBO(1, floor_normals.data(), floor_normals.size());
+				floor_pass.updateVBO(3, floor_colors.data(), floor_colors.size());
+			}
+			shownLevel = showLevel;
+			shownMode = terrainMode;
+			reload = false;
+		}
 
+		Frustum frustum(gui.getProjectionMatrix() * gui.getViewMatrix());
+		double dX = (maxX - minX) / (mapSize - 1);
+		double dZ = (maxZ - minZ) / (mapSize - 1);
+		// Bounds of the heights on screen over grid points [x0, x1] x
+		// [z0, z1]. GPU generated noise has no CPU side bounds, but every
+		// map type stays within [0, heightScale].
+		auto shownRange = [&](int x0, int z0, int x1, int z1, float& lo, float& hi) {
+			lo = 0.0f;
+			hi = terrain_height_scale;
+			if(gpu_perlin && terrainMode == 1)
+				return;
+			HeightMap& heightMap = generator.front();
+			int first = use_volume ? int(volume_level) : shownLevel;
+			int second = use_volume ? (first + 1) % animationSlices : first;
+			if(!heightMap.hasSlice(first) || !heightMap.hasSlice(second))
+				return;
+			float lo2, hi2;
+			heightMap.range(first, x0, z0, x1, z1, lo, hi);
+			heightMap.range(second, x0, z0, x1, z1, lo2, hi2);
+			lo = std::min(lo, lo2);
+			hi = std::max(hi, hi2);
+		};
+
+		if(streamTerrain)
+		{
+			if(!terrain_stream)
+			{
+				terrain_stream.reset(new TerrainStream(minX, minZ, dX,
+						std::max(1, generator.threadCount() - 1)));
+				size_t poolVertices = (size_t)terrain_stream->slots() * TerrainStream::tileVertices();
+				RenderDataInput stream_pass_input;
+				stream_pass_input.assign(0, "vertex_position", nullptr, poolVertices, 4, GL_FLOAT);
+				stream_pass_input.assign(1, "normal", nullptr, poolVertices, 4, GL_FLOAT);
+				stream_pass_input.assign(3, "color", nullptr, poolVertices, 4, GL_FLOAT);
+				stream_pass_input.assign_index(stream_tile_faces.data(), stream_tile_faces.size(), 3);
+				stream_pass.reset(new RenderPass(-1,
+						stream_pass_input,
+						{ terrain_mesh_vertex_shader, nullptr, floor_fragment_shader },
+						{ stream_model },
+						{ "fragment_color" }
+						));
+				stream_pass->setName("terrain stream");
+			}
+			if(streamStale)
+			{
+				terrain_stream->setParams(generator.front().params(), 0);
+				streamStale = false;
+			}
+			// Uploads are capped per frame so that a burst of finished
+			// tiles cannot stall a frame.
+			terrain_stream->update(gui.getCamera(), kStreamUploadsPerFrame,
+					[&stream_pass](int slot, const StreamMesh& mesh) {
+				size_t first = (size_t)slot * TerrainStream::tileVertices();
+				stream_pass->updateVBORange(0, first, mesh.vertices.data(), mesh.vertices.size());
+				stream_pass->updateVBORange(1, first, mesh.normals.data(), mesh.normals.size());
+				stream_pass->updateVBORange(3, first, mesh.colors.data(), mesh.colors.size());
+			});
+
+			// Tile meshes are tile-local, so a repeating field draws one
+			// slot at several places.
+			double tileSize = kStreamTileQuads * dX;
+			for(const StreamTile& tile : terrain_stream->tiles())
+			{
+				glm::vec3 lo(minX + tile.x * tileSize, tile.lo, minZ + tile.z * tileSize);
+				glm::vec3 hi(lo.x + tileSize, tile.hi, lo.z + tileSize);
+				if(!frustum.intersects(lo, hi))
+					continue;
+				stream_model_matrix = glm::translate(glm::mat4(1.0f), glm::vec3(lo.x, 0.0f, lo.z));
+				stream_pass->setup();
+				CHECK_GL_ERROR(glDrawElementsBaseVertex(GL_TRIANGLES, stream_tile_faces.size() * 3,
+						GL_UNSIGNED_INT, 0, tile.slot * TerrainStream::tileVertices()));
+			}
+		}
+		else if(gpuTerrain && gui.useLod())
+		{
+			// One patch per selected node; node positions the patch.
+			lod_nodes.clear();
+			terrain_lod.select(gui.getCamera(), 0.0f, terrain_height_scale, lod_nodes);
+			float skirt = kLodSkirtDepth * terrain_height_scale;
+			for(const LodNode& node : lod_nodes)
+			{
+				float lo, hi;
+				shownRange(int((node.x - minX) / dX), int((node.z - minZ) / dZ),
+				           int(std::ceil((node.x + node.size - minX) / dX)),
+				           int(std::ceil((node.z + node.size - minZ) / dZ)), lo, hi);
+				if(!frustum.intersects(glm::vec3(node.x, lo - skirt, node.z),
+				                       glm::vec3(node.x + node.size, hi, node.z + node.size)))
+					continue;
+				terrain_node = glm::vec4(node.x, node.z, node.size, skirt);
+				lod_pass.setup();
+				CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, terrain_lod.patchFaces().size() * 3, GL_UNSIGNED_INT, 0));
+			}
+		}
+		else
+		{
+			RenderPass* pass = &floor_pass;
+			if(gpuTerrain)
+			{
+				terrain_node = glm::vec4(minX, minZ, maxX - minX, 0.0f);
+				pass = &terrain_pass;
+			}
+			pass->setup();
+			// Draw the visible chunks, merging neighbours in the index
+			// buffer into one call.
+			int chunksZ = (mapSize - 2) / chunkQuads + 1;
+			size_t runStart = 0, runEnd = 0;
+			for(size_t i = 0; i + 1 < chunk_first.size(); ++i)
+			{
+				int x0 = int(i) / chunksZ * chunkQuads;
+				int z0 = int(i) % chunksZ * chunkQuads;
+				int x1 = std::min(x0 + chunkQuads, mapSize - 1);
+				int z1 = std::min(z0 + chunkQuads, mapSize - 1);
+				float lo, hi;
+				shownRange(x0, z0, x1, z1, lo, hi);
+				bool visible = frustum.intersects(glm::vec3(minX + x0 * dX, lo, minZ + z0 * dZ),
+				                                  glm::vec3(minX + x1 * dX, hi, minZ + z1 * dZ));
+				if(visible && runEnd == chunk_first[i])
+				{
+					runEnd = chunk_first[i + 1];
+					continue;
+				}
+				if(runEnd > runStart)
+					CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, (runEnd - runStart) * 3, GL_UNSIGNED_INT,
+					                              (const void*)(runStart * 3 * sizeof(unsigned))));
+				runStart = runEnd = chunk_first[i];
+				if(visible)
+					runEnd = chunk_first[i + 1];
+			}
+			if(runEnd > runStart)
+				CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, (runEnd - runStart) * 3, GL_UNSIGNED_INT,
+				                              (const void*)(runStart * 3 * sizeof(unsigned))));
 		}
-		floor_pass.setup();
-		// Draw our triangles.
-		CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, floor_faces.size() * 3, GL_UNSIGNED_INT, 0));
 		++level;
 		if (draw_object) {
 				// mesh.updateAnimation();
@@ -393,10 +851,9 @@ int main(int argc, char* argv[])
 
 			
 			// object_pass.setup();
-			// int mid = 0;
-			// while (object_pass.renderWithMaterial(mid))
-			// 	mid++;
+			// object_pass.renderMaterials();
 		}
+		GpuTimer::endFrame();
 		// Poll and swap.
 		glfwPollEvents();
 		glfwSwapBuffers(window);
@@ -1,24 +1,95 @@
 #include "perlin.h"
+#include "perlin_simd.h"
 
-Perlin::Perlin()
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+
+namespace
 {
+
+// Hash lookup table as defined by Ken Perlin. This is a randomly arranged
+// array of all numbers from 0-255 inclusive.
+const uint8_t referencePermutation[256] = { 151,160,137,91,90,15,
+    131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+    190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
+    88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
+    77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
+    102,143,54, 65,25,63,161, 1,216,80,73,209,76,132,187,208, 89,18,169,200,196,
+    135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,250,124,123,
+    5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
+    223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167, 43,172,9,
+    129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,97,228,
+    251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
+    49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
+    138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
+    };
+
+const PermutationTable* buildPermutation(unsigned seed)
+{
+    // operator new only guarantees 16 byte alignment before C++17, so
+    // align by hand. Tables are never freed.
+    size_t space = sizeof(PermutationTable) + alignof(PermutationTable);
+    void* storage = ::operator new(space);
+    PermutationTable* table = new(std::align(alignof(PermutationTable),
+            sizeof(PermutationTable), storage, space)) PermutationTable;
+
+    uint8_t values[256];
+    std::copy(referencePermutation, referencePermutation + 256, values);
+    if(seed != 0)
+    {
+        // Fisher-Yates with the raw generator output rather than a
+        // distribution, whose algorithm varies between standard
+        // libraries; a seed gives the same terrain everywhere.
+        std::mt19937 rng(seed);
+        for(int i = 255; i > 0; --i)
+            std::swap(values[i], values[rng() % (i + 1)]);
+    }
     for(int i = 0; i < 512; ++i)
-        p[i] = permutation[i % 256];
+        table->p[i] = values[i % 256];
+    return table;
+}
+
 }
 
-double Perlin::perlin(double x, double y, double z)
+const PermutationTable& PermutationTable::forSeed(unsigned seed)
+{
+    // Never destroyed, so tables stay valid for threads still running
+    // during static destruction.
+    static std::mutex* mutex = new std::mutex;
+    static std::map<unsigned, const PermutationTable*>* tables =
+        new std::map<unsigned, const PermutationTable*>;
+
+    std::lock_guard<std::mutex> lock(*mutex);
+    const PermutationTable*& table = (*tables)[seed];
+    if(!table)
+        table = buildPermutation(seed);
+    return *table;
+}
+
+template <typename Real>
+BasicPerlin<Real>::BasicPerlin(unsigned seed)
+    : p(PermutationTable::forSeed(seed).p)
+{
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::perlin(Real x, Real y, Real z) const
 {
     int xi = (int)x & 255;
     int yi = (int)y & 255;
     int zi = (int)z & 255;
 
-    double xf = x - (int)x;
-    double yf = y - (int)y;
-    double zf = z - (int)z;
+    Real xf = x - (int)x;
+    Real yf = y - (int)y;
+    Real zf = z - (int)z;
 
-    double u = fade(xf);
-    double v = fade(yf);
-    double w = fade(zf);
+    Real u = fade(xf);
+    Real v = fade(yf);
+    Real w = fade(zf);
 
     int aaa, aba, aab, abb, baa, bba, bab, bbb;
     aaa = p[p[p[     xi ] +      yi ] +      zi ];
@@ -30,7 +101,49 @@ double Perlin::perlin(double x, double y, double z)
     bab = p[p[p[incr(xi)] +      yi ] + incr(zi)];
     bbb = p[p[p[incr(xi)] + incr(yi)] + incr(zi)];
 
-    double x1, x2, y1, y2;
+    Real x1, x2, y1, y2;
+    x1 = lerp(grad(aaa, xf, yf, zf), grad(baa, xf-1, yf, zf), u);
+    x2 = lerp(grad(aba, xf, yf-1, zf), grad(bba, xf-1, yf-1, zf), u);
+    y1 = lerp(x1, x2, v);
+    x1 = lerp(grad(aab, xf, yf, zf-1), grad(bab, xf-1, yf, zf-1), u);
+    x2 = lerp(grad(abb, xf, yf-1, zf-1), grad(bbb, xf-1, yf-1, zf-1), u);
+    y2 = lerp(x1, x2, v);
+
+    return (lerp(y1, y2, w) + 1) / 2;
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::perlinPeriodic(Real x, Real y, Real z, const int* period) const
+{
+    int xc = (int)x;
+    int yc = (int)y;
+    int zc = (int)z;
+
+    // Wrapping both corners of the cell by the period, before the table
+    // lookup, is what makes the lattice repeat.
+    int xi0 = (xc % period[0]) & 255, xi1 = ((xc + 1) % period[0]) & 255;
+    int yi0 = (yc % period[1]) & 255, yi1 = ((yc + 1) % period[1]) & 255;
+    int zi0 = (zc % period[2]) & 255, zi1 = ((zc + 1) % period[2]) & 255;
+
+    Real xf = x - xc;
+    Real yf = y - yc;
+    Real zf = z - zc;
+
+    Real u = fade(xf);
+    Real v = fade(yf);
+    Real w = fade(zf);
+
+    int aaa, aba, aab, abb, baa, bba, bab, bbb;
+    aaa = p[p[p[xi0] + yi0] + zi0];
+    aba = p[p[p[xi0] + yi1] + zi0];
+    aab = p[p[p[xi0] + yi0] + zi1];
+    abb = p[p[p[xi0] + yi1] + zi1];
+    baa = p[p[p[xi1] + yi0] + zi0];
+    bba = p[p[p[xi1] + yi1] + zi0];
+    bab = p[p[p[xi1] + yi0] + zi1];
+    bbb = p[p[p[xi1] + yi1] + zi1];
+
+    Real x1, x2, y1, y2;
     x1 = lerp(grad(aaa, xf, yf, zf), grad(baa, xf-1, yf, zf), u);
     x2 = lerp(grad(aba, xf, yf-1, zf), grad(bba, xf-1, yf-1, zf), u);
     y1 = lerp(x1, x2, v);
@@ -41,19 +154,144 @@ double Perlin::perlin(double x, double y, double z)
     return (lerp(y1, y2, w) + 1) / 2;
 }
 
-double Perlin::fade(double t)
+template <typename Real>
+Real BasicPerlin<Real>::perlinDeriv(Real x, Real y, Real z, Real* gradient) const
+{
+    int xi = (int)x & 255;
+    int yi = (int)y & 255;
+    int zi = (int)z & 255;
+
+    int hash[8];
+    hash[0] = p[p[p[     xi ] +      yi ] +      zi ];
+    hash[1] = p[p[p[incr(xi)] +      yi ] +      zi ];
+    hash[2] = p[p[p[     xi ] + incr(yi)] +      zi ];
+    hash[3] = p[p[p[incr(xi)] + incr(yi)] +      zi ];
+    hash[4] = p[p[p[     xi ] +      yi ] + incr(zi)];
+    hash[5] = p[p[p[incr(xi)] +      yi ] + incr(zi)];
+    hash[6] = p[p[p[     xi ] + incr(yi)] + incr(zi)];
+    hash[7] = p[p[p[incr(xi)] + incr(yi)] + incr(zi)];
+
+    return cellDeriv(hash, x - (int)x, y - (int)y, z - (int)z, gradient);
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::perlinPeriodicDeriv(Real x, Real y, Real z, const int* period,
+                                            Real* gradient) const
+{
+    int xc = (int)x;
+    int yc = (int)y;
+    int zc = (int)z;
+
+    // Same wrapping as perlinPeriodic.
+    int xi0 = (xc % period[0]) & 255, xi1 = ((xc + 1) % period[0]) & 255;
+    int yi0 = (yc % period[1]) & 255, yi1 = ((yc + 1) % period[1]) & 255;
+    int zi0 = (zc % period[2]) & 255, zi1 = ((zc + 1) % period[2]) & 255;
+
+    int hash[8];
+    hash[0] = p[p[p[xi0] + yi0] + zi0];
+    hash[1] = p[p[p[xi1] + yi0] + zi0];
+    hash[2] = p[p[p[xi0] + yi1] + zi0];
+    hash[3] = p[p[p[xi1] + yi1] + zi0];
+    hash[4] = p[p[p[xi0] + yi0] + zi1];
+    hash[5] = p[p[p[xi1] + yi0] + zi1];
+    hash[6] = p[p[p[xi0] + yi1] + zi1];
+    hash[7] = p[p[p[xi1] + yi1] + zi1];
+
+    return cellDeriv(hash, x - xc, y - yc, z - zc, gradient);
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::cellDeriv(const int* hash, Real xf, Real yf, Real zf, Real* gradient) const
+{
+    Real u = fade(xf);
+    Real v = fade(yf);
+    Real w = fade(zf);
+
+    Real gaaa = grad(hash[0], xf, yf, zf),     gbaa = grad(hash[1], xf-1, yf, zf);
+    Real gaba = grad(hash[2], xf, yf-1, zf),   gbba = grad(hash[3], xf-1, yf-1, zf);
+    Real gaab = grad(hash[4], xf, yf, zf-1),   gbab = grad(hash[5], xf-1, yf, zf-1);
+    Real gabb = grad(hash[6], xf, yf-1, zf-1), gbbb = grad(hash[7], xf-1, yf-1, zf-1);
+
+    Real x1, x2, y1, y2, x3, x4;
+    x1 = lerp(gaaa, gbaa, u);
+    x2 = lerp(gaba, gbba, u);
+    y1 = lerp(x1, x2, v);
+    x3 = lerp(gaab, gbab, u);
+    x4 = lerp(gabb, gbbb, u);
+    y2 = lerp(x3, x4, v);
+
+    // Each corner gradient is linear in the sample point, so its slope is
+    // its coefficient vector. The trilinear blend of those, plus the fade
+    // curves' slopes times the differences they blend, is the gradient.
+    Real c[8][3];
+    for(int i = 0; i < 8; ++i)
+        gradCoeffs(hash[i], c[i]);
+    for(int i = 0; i < 3; ++i)
+    {
+        Real near = lerp(lerp(c[0][i], c[1][i], u), lerp(c[2][i], c[3][i], u), v);
+        Real far = lerp(lerp(c[4][i], c[5][i], u), lerp(c[6][i], c[7][i], u), v);
+        gradient[i] = lerp(near, far, w);
+    }
+    Real dNdu = lerp(lerp(gbaa - gaaa, gbba - gaba, v), lerp(gbab - gaab, gbbb - gabb, v), w);
+    Real dNdv = lerp(x2 - x1, x4 - x3, w);
+    Real dNdw = y2 - y1;
+    gradient[0] += dNdu * fadeDeriv(xf);
+    gradient[1] += dNdv * fadeDeriv(yf);
+    gradient[2] += dNdw * fadeDeriv(zf);
+
+    // perlin() maps [-1, 1] to [0, 1].
+    for(int i = 0; i < 3; ++i)
+        gradient[i] /= 2;
+    return (lerp(y1, y2, w) + 1) / 2;
+}
+
+template <typename Real>
+void BasicPerlin<Real>::perlinBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.batch)
+        done = kernels.batch(p, x, y, z, out, n, nullptr);
+    for(size_t i = done; i < n; ++i)
+        out[i] = perlin(x[i], y[i], z[i]);
+}
+
+template <typename Real>
+void BasicPerlin<Real>::perlinPeriodicBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n,
+                                            const int* period) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.batch)
+        done = kernels.batch(p, x, y, z, out, n, period);
+    for(size_t i = done; i < n; ++i)
+        out[i] = perlinPeriodic(x[i], y[i], z[i], period);
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::fade(Real t) const
 {
     return t * t * t * (t * (t * 6 - 15) + 10);
 }
 
-int Perlin::incr(int num)
+template <typename Real>
+Real BasicPerlin<Real>::fadeDeriv(Real t) const
+{
+    return 30 * t * t * (t - 1) * (t - 1);
+}
+
+template <typename Real>
+int BasicPerlin<Real>::incr(int num) const
 {
     num++;
     return num;
 }
 
 // Source: http://riven8192.blogspot.com/2010/08/calculate-perlinnoise-twice-as-fast.html
-double Perlin::grad(int hash, double x, double y, double z)
+template <typename Real>
+Real BasicPerlin<Real>::grad(int hash, Real x, Real y, Real z) const
 {
     switch(hash & 0xF)
     {
@@ -77,17 +315,36 @@ double Perlin::grad(int hash, double x, double y, double z)
     }
 }
 
-double Perlin::lerp(double a, double b, double x)
+template <typename Real>
+void BasicPerlin<Real>::gradCoeffs(int hash, Real* coeffs) const
+{
+    // grad() on the unit axes, which reads off its coefficients since it
+    // is linear; tabulated because cellDeriv needs them for every corner.
+    static const signed char table[16][3] = {
+        {  1,  1,  0 }, { -1,  1,  0 }, {  1, -1,  0 }, { -1, -1,  0 },
+        {  1,  0,  1 }, { -1,  0,  1 }, {  1,  0, -1 }, { -1,  0, -1 },
+        {  0,  1,  1 }, {  0, -1,  1 }, {  0,  1, -1 }, {  0, -1, -1 },
+        {  1,  1,  0 }, {  0, -1,  1 }, { -1,  1,  0 }, {  0, -1, -1 }
+    };
+    const signed char* row = table[hash & 0xF];
+    coeffs[0] = row[0];
+    coeffs[1] = row[1];
+    coeffs[2] = row[2];
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::lerp(Real a, Real b, Real x) const
 {
     return a + x * (b - a);
 }
 
-double Perlin::OctavePerlin(double x, double y, double z, int octaves, double persistence)
+template <typename Real>
+Real BasicPerlin<Real>::OctavePerlin(Real x, Real y, Real z, int octaves, Real persistence) const
 {
-    double total = 0;
-    double frequency = 1;
-    double amplitude = 1;
-    double maxVal = 0;
+    Real total = 0;
+    Real frequency = 1;
+    Real amplitude = 1;
+    Real maxVal = 0;
 
     for(int i = 0; i < octaves; ++i)
     {
@@ -100,4 +357,203 @@ double Perlin::OctavePerlin(double x, double y, double z, int octaves, double pe
     }
 
     return total / maxVal;
-}
\ No newline at end of file
+}
+
+template <typename Real>
+BasicPerlin<Real>::OctaveTable::OctaveTable(int octaves, Real persistence)
+    : maxVal(0)
+{
+    Real f = 1;
+    Real amp = 1;
+    for(int i = 0; i < std::min(octaves, maxPerlinOctaves); ++i)
+    {
+        frequency.push_back(f);
+        amplitude.push_back(amp);
+        maxVal += amp;
+
+        amp *= persistence;
+        f *= 2;
+    }
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::OctavePerlin(Real x, Real y, Real z, const OctaveTable& table) const
+{
+    Real total = 0;
+    for(int i = 0; i < table.octaves(); ++i)
+    {
+        Real f = table.frequency[i];
+        total += perlin(x * f, y * f, z * f) * table.amplitude[i];
+    }
+    return total / table.maxVal;
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::OctavePerlinPeriodic(Real x, Real y, Real z, const OctaveTable& table,
+                                             const int* period) const
+{
+    Real total = 0;
+    for(int i = 0; i < table.octaves(); ++i)
+    {
+        Real f = table.frequency[i];
+        int scaled[3] = { octavePeriod(period[0], f), octavePeriod(period[1], f), octavePeriod(period[2], f) };
+        total += perlinPeriodic(x * f, y * f, z * f, scaled) * table.amplitude[i];
+    }
+    return total / table.maxVal;
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::OctavePerlinDeriv(Real x, Real y, Real z, const OctaveTable& table, Real* gradient) const
+{
+    Real total = 0;
+    gradient[0] = gradient[1] = gradient[2] = 0;
+    for(int i = 0; i < table.octaves(); ++i)
+    {
+        Real f = table.frequency[i];
+        Real g[3];
+        total += perlinDeriv(x * f, y * f, z * f, g) * table.amplitude[i];
+        // Chain rule through the frequency scaling.
+        for(int j = 0; j < 3; ++j)
+            gradient[j] += g[j] * (f * table.amplitude[i]);
+    }
+    for(int j = 0; j < 3; ++j)
+        gradient[j] /= table.maxVal;
+    return total / table.maxVal;
+}
+
+template <typename Real>
+Real BasicPerlin<Real>::OctavePerlinPeriodicDeriv(Real x, Real y, Real z, const OctaveTable& table,
+                                                  const int* period, Real* gradient) const
+{
+    Real total = 0;
+    gradient[0] = gradient[1] = gradient[2] = 0;
+    for(int i = 0; i < table.octaves(); ++i)
+    {
+        Real f = table.frequency[i];
+        int scaled[3] = { octavePeriod(period[0], f), octavePeriod(period[1], f), octavePeriod(period[2], f) };
+        Real g[3];
+        total += perlinPeriodicDeriv(x * f, y * f, z * f, scaled, g) * table.amplitude[i];
+        for(int j = 0; j < 3; ++j)
+            gradient[j] += g[j] * (f * table.amplitude[i]);
+    }
+    for(int j = 0; j < 3; ++j)
+        gradient[j] /= table.maxVal;
+    return total / table.maxVal;
+}
+
+template <typename Real>
+void BasicPerlin<Real>::OctavePerlinBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n,
+                                          const OctaveTable& table) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.octaves)
+        done = kernels.octaves(p, x, y, z, out, n,
+                table.frequency.data(), table.amplitude.data(),
+                table.octaves(), table.maxVal, nullptr);
+    for(size_t i = done; i < n; ++i)
+        out[i] = OctavePerlin(x[i], y[i], z[i], table);
+}
+
+template <typename Real>
+void BasicPerlin<Real>::OctavePerlinPeriodicBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                                  size_t n, const OctaveTable& table,
+                                                  const int* period) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.octaves)
+        done = kernels.octaves(p, x, y, z, out, n,
+                table.frequency.data(), table.amplitude.data(),
+                table.octaves(), table.maxVal, period);
+    for(size_t i = done; i < n; ++i)
+        out[i] = OctavePerlinPeriodic(x[i], y[i], z[i], table, period);
+}
+
+template <typename Real>
+void BasicPerlin<Real>::perlinDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                         Real* dx, Real* dy, Real* dz, size_t n) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.deriv)
+        done = kernels.deriv(p, x, y, z, out, dx, dy, dz, n, nullptr);
+    for(size_t i = done; i < n; ++i)
+    {
+        Real g[3];
+        out[i] = perlinDeriv(x[i], y[i], z[i], g);
+        dx[i] = g[0];
+        dy[i] = g[1];
+        dz[i] = g[2];
+    }
+}
+
+template <typename Real>
+void BasicPerlin<Real>::perlinPeriodicDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                                 Real* dx, Real* dy, Real* dz, size_t n,
+                                                 const int* period) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.deriv)
+        done = kernels.deriv(p, x, y, z, out, dx, dy, dz, n, period);
+    for(size_t i = done; i < n; ++i)
+    {
+        Real g[3];
+        out[i] = perlinPeriodicDeriv(x[i], y[i], z[i], period, g);
+        dx[i] = g[0];
+        dy[i] = g[1];
+        dz[i] = g[2];
+    }
+}
+
+template <typename Real>
+void BasicPerlin<Real>::OctavePerlinDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                               Real* dx, Real* dy, Real* dz, size_t n,
+                                               const OctaveTable& table) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.octaveDeriv)
+        done = kernels.octaveDeriv(p, x, y, z, out, dx, dy, dz, n,
+                table.frequency.data(), table.amplitude.data(),
+                table.octaves(), table.maxVal, nullptr);
+    for(size_t i = done; i < n; ++i)
+    {
+        Real g[3];
+        out[i] = OctavePerlinDeriv(x[i], y[i], z[i], table, g);
+        dx[i] = g[0];
+        dy[i] = g[1];
+        dz[i] = g[2];
+    }
+}
+
+template <typename Real>
+void BasicPerlin<Real>::OctavePerlinPeriodicDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                                       Real* dx, Real* dy, Real* dz, size_t n,
+                                                       const OctaveTable& table, const int* period) const
+{
+    static const PerlinKernels<Real> kernels = selectPerlinKernels<Real>();
+
+    size_t done = 0;
+    if(kernels.octaveDeriv)
+        done = kernels.octaveDeriv(p, x, y, z, out, dx, dy, dz, n,
+                table.frequency.data(), table.amplitude.data(),
+                table.octaves(), table.maxVal, period);
+    for(size_t i = done; i < n; ++i)
+    {
+        Real g[3];
+        out[i] = OctavePerlinPeriodicDeriv(x[i], y[i], z[i], table, period, g);
+        dx[i] = g[0];
+        dy[i] = g[1];
+        dz[i] = g[2];
+    }
+}
+
+template class BasicPerlin<float>;
+template class BasicPerlin<double>;
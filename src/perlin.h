@@ -5,35 +5,139 @@
 #define PERLIN_H
 
 #include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
-class Perlin
+// The doubled table Perlin hashes lattice points with: entry i + 256
+// repeats entry i, so lookups never wrap. Tables are immutable and shared;
+// forSeed() builds a seed's table on first use and returns the same one
+// from then on, from any thread. A generator then costs a pointer rather
+// than a 3 KB int copy, and the 512 bytes fill eight whole cache lines.
+struct alignas(64) PermutationTable
+{
+    uint8_t p[512];
+
+    // Seed 0 is Ken Perlin's reference table; other seeds shuffle it.
+    static const PermutationTable& forSeed(unsigned seed);
+};
+
+// Octave counts are capped here. Octave i samples at 2^i times the
+// coordinates, so past this float coordinates keep no bits inside a
+// cell and int lattice indices head for overflow.
+const int maxPerlinOctaves = 16;
+
+// Real is the scalar type used for coordinates and results; float and
+// double are instantiated in perlin.cc. Every member function is const,
+// so one instance may serve any number of threads.
+//
+// PerlinF stays within 1e-6 of the double reference for coordinates in
+// [0, 256); tests/perlin_test.cc checks it over the 128^3 grid main.cc
+// samples and a million random points. The error grows with coordinate
+// magnitude, since the offset inside a lattice cell keeps fewer float
+// bits.
+template <typename Real>
+class BasicPerlin
 {
     private:
-        int permutation[256] = { 151,160,137,91,90,15,					// Hash lookup table as defined by Ken Perlin.  This is a randomly
-            131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,	// arranged array of all numbers from 0-255 inclusive.
-            190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
-            88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
-            77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
-            102,143,54, 65,25,63,161, 1,216,80,73,209,76,132,187,208, 89,18,169,200,196,
-            135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,250,124,123,
-            5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
-            223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167, 43,172,9,
-            129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,97,228,
-            251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
-            49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
-            138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
-            };
-        int p[512];
+        // Doubled permutation table, shared with every instance of the
+        // same seed.
+        const uint8_t* p;
+
+        // Coefficients (each -1, 0 or 1) of x, y and z in grad(hash, x, y, z).
+        void gradCoeffs(int hash, Real* coeffs) const;
+        // Value and gradient inside one lattice cell, given the hashes of
+        // its corners in aaa, baa, aba, bba, aab, bab, abb, bbb order.
+        Real cellDeriv(const int* hash, Real xf, Real yf, Real zf, Real* gradient) const;
 
     public:
-        Perlin();
-
-        double perlin(double x, double y, double z);
-        double fade(double t);
-        int incr(int num);
-        double grad(int hash, double x, double y, double z);
-        double lerp(double a, double b, double x);
-        double OctavePerlin(double x, double y, double z, int octaves, double persistence);
+        // Frequency and amplitude of every octave, and the sum of the
+        // amplitudes OctavePerlin normalizes by. These only depend on the
+        // octave count and persistence, so build one per parameter change
+        // rather than per sample. At most maxPerlinOctaves octaves are
+        // kept.
+        struct OctaveTable
+        {
+            OctaveTable(int octaves, Real persistence);
+            int octaves() const { return int(frequency.size()); }
+
+            std::vector<Real> frequency, amplitude;
+            Real maxVal;
+        };
+
+        explicit BasicPerlin(unsigned seed = 0);
+
+        // The 256 entry hash table, e.g. to upload it for the GLSL port.
+        const uint8_t* permutationTable() const { return p; }
+
+        Real perlin(Real x, Real y, Real z) const;
+        // Evaluates perlin() for n points stored as separate x, y and z
+        // arrays. Uses AVX2 or SSE2 kernels when the CPU has them; the
+        // results are bit-identical to calling perlin() per point.
+        void perlinBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n) const;
+        // perlin() repeating every period[0], period[1] and period[2]
+        // lattice cells along x, y and z; any positive period works, not
+        // only divisors of 256. With a period of 256 on every axis it is
+        // perlin() bit for bit. Coordinates must be non-negative, as for
+        // perlin().
+        Real perlinPeriodic(Real x, Real y, Real z, const int* period) const;
+        // perlinBatch counterpart of perlinPeriodic, bit-identical to it.
+        void perlinPeriodicBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n,
+                                 const int* period) const;
+        // perlin() plus its analytic gradient: gradient[0..2] receives
+        // d/dx, d/dy and d/dz of the returned value. The value is
+        // bit-identical to perlin(x, y, z).
+        Real perlinDeriv(Real x, Real y, Real z, Real* gradient) const;
+        // perlinPeriodic with its gradient; the value is bit-identical to
+        // perlinPeriodic(x, y, z, period).
+        Real perlinPeriodicDeriv(Real x, Real y, Real z, const int* period, Real* gradient) const;
+        Real fade(Real t) const;
+        // d fade(t) / dt
+        Real fadeDeriv(Real t) const;
+        int incr(int num) const;
+        Real grad(int hash, Real x, Real y, Real z) const;
+        Real lerp(Real a, Real b, Real x) const;
+        Real OctavePerlin(Real x, Real y, Real z, int octaves, Real persistence) const;
+        // Fractal noise with precomputed octave parameters; equal to
+        // OctavePerlin(x, y, z, octaves, persistence) bit for bit.
+        Real OctavePerlin(Real x, Real y, Real z, const OctaveTable& table) const;
+        // OctavePerlin with its gradient, summed through the octaves the
+        // same way the values are. One evaluation per octave, where
+        // finite differences would need three more.
+        Real OctavePerlinDeriv(Real x, Real y, Real z, const OctaveTable& table, Real* gradient) const;
+        // OctavePerlin built from perlinPeriodic. Octave i repeats every
+        // period * frequency[i] cells of its own coordinates, so the sum
+        // repeats every period cells.
+        Real OctavePerlinPeriodic(Real x, Real y, Real z, const OctaveTable& table,
+                                  const int* period) const;
+        // OctavePerlinPeriodic with its gradient, as OctavePerlinDeriv.
+        Real OctavePerlinPeriodicDeriv(Real x, Real y, Real z, const OctaveTable& table,
+                                       const int* period, Real* gradient) const;
+        // perlinBatch counterpart of OctavePerlin. All octaves of a group
+        // of points are summed in SIMD registers in one pass.
+        void OctavePerlinBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n,
+                               const OctaveTable& table) const;
+        // OctavePerlinBatch counterpart of OctavePerlinPeriodic.
+        void OctavePerlinPeriodicBatch(const Real* x, const Real* y, const Real* z, Real* out, size_t n,
+                                       const OctaveTable& table, const int* period) const;
+        // perlinBatch counterpart of perlinDeriv: d/dx, d/dy and d/dz of
+        // out[i] go to dx[i], dy[i] and dz[i]. Bit-identical to calling
+        // perlinDeriv per point.
+        void perlinDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                              Real* dx, Real* dy, Real* dz, size_t n) const;
+        // perlinDerivBatch counterpart of perlinPeriodicDeriv.
+        void perlinPeriodicDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                      Real* dx, Real* dy, Real* dz, size_t n, const int* period) const;
+        // perlinDerivBatch counterpart of OctavePerlinDeriv.
+        void OctavePerlinDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                    Real* dx, Real* dy, Real* dz, size_t n, const OctaveTable& table) const;
+        // perlinDerivBatch counterpart of OctavePerlinPeriodicDeriv.
+        void OctavePerlinPeriodicDerivBatch(const Real* x, const Real* y, const Real* z, Real* out,
+                                            Real* dx, Real* dy, Real* dz, size_t n,
+                                            const OctaveTable& table, const int* period) const;
 };
 
-#endif
\ No newline at end of file
+typedef BasicPerlin<double> Perlin;
+typedef BasicPerlin<float> PerlinF;
+
+#endif
@@ -0,0 +1,347 @@
+// Lane-generic body of the Perlin batch kernels. perlin_simd.cc includes
+// this once per instruction set with PERLIN_TARGET set to the matching
+// function attribute; S supplies the vector type and its operations.
+//
+// Every operation mirrors Perlin::perlin step for step (no FMA, same
+// association) so the vector results are bit-identical to the scalar ones.
+
+template <typename S>
+PERLIN_TARGET static inline typename S::V fade(typename S::V t)
+{
+    typename S::V a = S::mul(S::mul(t, t), t);
+    typename S::V b = S::add(S::mul(t, S::sub(S::mul(t, S::set1(6)), S::set1(15))), S::set1(10));
+    return S::mul(a, b);
+}
+
+template <typename S>
+PERLIN_TARGET static inline typename S::V lerp(typename S::V a, typename S::V b, typename S::V t)
+{
+    return S::add(a, S::mul(t, S::sub(b, a)));
+}
+
+template <typename S>
+PERLIN_TARGET static inline typename S::V fadeDeriv(typename S::V t)
+{
+    typename S::V t1 = S::sub(t, S::set1(1));
+    return S::mul(S::mul(S::mul(S::mul(S::set1(30), t), t), t1), t1);
+}
+
+// Hashes of the corners of every lane's lattice cell, in the aaa, baa,
+// aba, bba, aab, bab, abb, bbb order BasicPerlin::cellDeriv takes them.
+// Periodic selects perlinPeriodic's lattice wrapping, by period, at
+// compile time.
+template <typename S, bool Periodic>
+PERLIN_TARGET static inline void cornerHashes(const uint8_t* p,
+        const int* xt, const int* yt, const int* zt, const int* period, int (*hash)[S::N])
+{
+    // The hash chain is a dependent series of table lookups, which
+    // gathers do not speed up; resolve it per lane.
+    if(Periodic)
+    {
+        for(int l = 0; l < S::N; ++l)
+        {
+            // Both corners wrapped by the period before hashing, as in
+            // perlinPeriodic.
+            int xi0 = (xt[l] % period[0]) & 255, xi1 = ((xt[l] + 1) % period[0]) & 255;
+            int yi0 = (yt[l] % period[1]) & 255, yi1 = ((yt[l] + 1) % period[1]) & 255;
+            int zi0 = (zt[l] % period[2]) & 255, zi1 = ((zt[l] + 1) % period[2]) & 255;
+            int a0 = p[xi0] + yi0;
+            int a1 = p[xi0] + yi1;
+            int b0 = p[xi1] + yi0;
+            int b1 = p[xi1] + yi1;
+            hash[0][l] = p[p[a0] + zi0];
+            hash[1][l] = p[p[b0] + zi0];
+            hash[2][l] = p[p[a1] + zi0];
+            hash[3][l] = p[p[b1] + zi0];
+            hash[4][l] = p[p[a0] + zi1];
+            hash[5][l] = p[p[b0] + zi1];
+            hash[6][l] = p[p[a1] + zi1];
+            hash[7][l] = p[p[b1] + zi1];
+        }
+    }
+    else
+    {
+        for(int l = 0; l < S::N; ++l)
+        {
+            int xi = xt[l] & 255;
+            int yi = yt[l] & 255;
+            int zi = zt[l] & 255;
+            int a = p[xi] + yi;
+            int b = p[xi + 1] + yi;
+            int aa = p[a] + zi;
+            int ab = p[a + 1] + zi;
+            int ba = p[b] + zi;
+            int bb = p[b + 1] + zi;
+            hash[0][l] = p[aa];
+            hash[1][l] = p[ba];
+            hash[2][l] = p[ab];
+            hash[3][l] = p[bb];
+            hash[4][l] = p[aa + 1];
+            hash[5][l] = p[ba + 1];
+            hash[6][l] = p[ab + 1];
+            hash[7][l] = p[bb + 1];
+        }
+    }
+}
+
+// Noise at one vector of points, as perlin() or perlinPeriodic.
+template <typename S, bool Periodic>
+PERLIN_TARGET static inline typename S::V noise(const uint8_t* p,
+        typename S::V vx, typename S::V vy, typename S::V vz, const int* period)
+{
+    typedef typename S::V V;
+    const int N = S::N;
+
+    int xt[N], yt[N], zt[N];
+    V xf = S::sub(vx, S::trunc(vx, xt));
+    V yf = S::sub(vy, S::trunc(vy, yt));
+    V zf = S::sub(vz, S::trunc(vz, zt));
+
+    int hash[8][N];
+    cornerHashes<S, Periodic>(p, xt, yt, zt, period, hash);
+
+    V u = fade<S>(xf);
+    V v = fade<S>(yf);
+    V w = fade<S>(zf);
+
+    V one = S::set1(1);
+    V xf1 = S::sub(xf, one);
+    V yf1 = S::sub(yf, one);
+    V zf1 = S::sub(zf, one);
+
+    V x1, x2, y1, y2;
+    x1 = lerp<S>(S::grad(hash[0], xf, yf, zf), S::grad(hash[1], xf1, yf, zf), u);
+    x2 = lerp<S>(S::grad(hash[2], xf, yf1, zf), S::grad(hash[3], xf1, yf1, zf), u);
+    y1 = lerp<S>(x1, x2, v);
+    x1 = lerp<S>(S::grad(hash[4], xf, yf, zf1), S::grad(hash[5], xf1, yf, zf1), u);
+    x2 = lerp<S>(S::grad(hash[6], xf, yf1, zf1), S::grad(hash[7], xf1, yf1, zf1), u);
+    y2 = lerp<S>(x1, x2, v);
+
+    return S::div(S::add(lerp<S>(y1, y2, w), one), S::set1(2));
+}
+
+// noise() plus its gradient into gradient[0..2], step for step as
+// BasicPerlin::cellDeriv.
+template <typename S, bool Periodic>
+PERLIN_TARGET static inline typename S::V noiseDeriv(const uint8_t* p,
+        typename S::V vx, typename S::V vy, typename S::V vz, const int* period,
+        typename S::V* gradient)
+{
+    typedef typename S::V V;
+    const int N = S::N;
+
+    int xt[N], yt[N], zt[N];
+    V xf = S::sub(vx, S::trunc(vx, xt));
+    V yf = S::sub(vy, S::trunc(vy, yt));
+    V zf = S::sub(vz, S::trunc(vz, zt));
+
+    int hash[8][N];
+    cornerHashes<S, Periodic>(p, xt, yt, zt, period, hash);
+
+    V u = fade<S>(xf);
+    V v = fade<S>(yf);
+    V w = fade<S>(zf);
+
+    V zero = S::set1(0);
+    V one = S::set1(1);
+    V xf1 = S::sub(xf, one);
+    V yf1 = S::sub(yf, one);
+    V zf1 = S::sub(zf, one);
+
+    V gaaa = S::grad(hash[0], xf, yf, zf),    gbaa = S::grad(hash[1], xf1, yf, zf);
+    V gaba = S::grad(hash[2], xf, yf1, zf),   gbba = S::grad(hash[3], xf1, yf1, zf);
+    V gaab = S::grad(hash[4], xf, yf, zf1),   gbab = S::grad(hash[5], xf1, yf, zf1);
+    V gabb = S::grad(hash[6], xf, yf1, zf1),  gbbb = S::grad(hash[7], xf1, yf1, zf1);
+
+    V x1 = lerp<S>(gaaa, gbaa, u);
+    V x2 = lerp<S>(gaba, gbba, u);
+    V y1 = lerp<S>(x1, x2, v);
+    V x3 = lerp<S>(gaab, gbab, u);
+    V x4 = lerp<S>(gabb, gbbb, u);
+    V y2 = lerp<S>(x3, x4, v);
+
+    // grad() on a unit axis is that axis's coefficient, as gradCoeffs
+    // tabulates.
+    const V axes[3][3] = { { one, zero, zero }, { zero, one, zero }, { zero, zero, one } };
+    for(int i = 0; i < 3; ++i)
+    {
+        V c[8];
+        for(int k = 0; k < 8; ++k)
+            c[k] = S::grad(hash[k], axes[i][0], axes[i][1], axes[i][2]);
+        V near = lerp<S>(lerp<S>(c[0], c[1], u), lerp<S>(c[2], c[3], u), v);
+        V far = lerp<S>(lerp<S>(c[4], c[5], u), lerp<S>(c[6], c[7], u), v);
+        gradient[i] = lerp<S>(near, far, w);
+    }
+    V dNdu = lerp<S>(lerp<S>(S::sub(gbaa, gaaa), S::sub(gbba, gaba), v),
+                     lerp<S>(S::sub(gbab, gaab), S::sub(gbbb, gabb), v), w);
+    V dNdv = lerp<S>(S::sub(x2, x1), S::sub(x4, x3), w);
+    V dNdw = S::sub(y2, y1);
+    gradient[0] = S::add(gradient[0], S::mul(dNdu, fadeDeriv<S>(xf)));
+    gradient[1] = S::add(gradient[1], S::mul(dNdv, fadeDeriv<S>(yf)));
+    gradient[2] = S::add(gradient[2], S::mul(dNdw, fadeDeriv<S>(zf)));
+
+    V two = S::set1(2);
+    for(int i = 0; i < 3; ++i)
+        gradient[i] = S::div(gradient[i], two);
+    return S::div(S::add(lerp<S>(y1, y2, w), one), two);
+}
+
+template <typename S, bool Periodic>
+PERLIN_TARGET static size_t perlinLoop(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, size_t n, const int* period)
+{
+    size_t i = 0;
+    for(; i + S::N <= n; i += S::N)
+        S::store(out + i, noise<S, Periodic>(p, S::load(x + i), S::load(y + i), S::load(z + i), period));
+    return i;
+}
+
+template <typename S>
+PERLIN_TARGET static size_t perlinKernel(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, size_t n, const int* period)
+{
+    if(period)
+        return perlinLoop<S, true>(p, x, y, z, out, n, period);
+    return perlinLoop<S, false>(p, x, y, z, out, n, nullptr);
+}
+
+// period holds three periods per octave here, already scaled.
+template <typename S, bool Periodic>
+PERLIN_TARGET static size_t octaveLoop(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, size_t n,
+        const typename S::Real* frequency, const typename S::Real* amplitude,
+        int octaves, typename S::Real maxVal, const int* period)
+{
+    typedef typename S::V V;
+
+    size_t i = 0;
+    for(; i + S::N <= n; i += S::N)
+    {
+        V vx = S::load(x + i);
+        V vy = S::load(y + i);
+        V vz = S::load(z + i);
+        V total = S::set1(0);
+        for(int o = 0; o < octaves; ++o)
+        {
+            V f = S::set1(frequency[o]);
+            V n = noise<S, Periodic>(p, S::mul(vx, f), S::mul(vy, f), S::mul(vz, f),
+                                     Periodic ? period + 3 * o : nullptr);
+            total = S::add(total, S::mul(n, S::set1(amplitude[o])));
+        }
+        S::store(out + i, S::div(total, S::set1(maxVal)));
+    }
+    return i;
+}
+
+// Octave o repeats every period * frequency[o] of its own cells; three
+// periods per octave, as octaveLoop and octaveDerivLoop take them.
+template <typename Real>
+static std::vector<int> scalePeriods(const int* period, const Real* frequency, int octaves)
+{
+    std::vector<int> scaled;
+    for(int o = 0; o < octaves; ++o)
+        for(int a = 0; a < 3; ++a)
+            scaled.push_back(octavePeriod(period[a], frequency[o]));
+    return scaled;
+}
+
+template <typename S>
+PERLIN_TARGET static size_t octaveKernel(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, size_t n,
+        const typename S::Real* frequency, const typename S::Real* amplitude,
+        int octaves, typename S::Real maxVal, const int* period)
+{
+    if(!period)
+        return octaveLoop<S, false>(p, x, y, z, out, n, frequency, amplitude, octaves, maxVal, nullptr);
+    std::vector<int> scaled = scalePeriods(period, frequency, octaves);
+    return octaveLoop<S, true>(p, x, y, z, out, n, frequency, amplitude, octaves, maxVal, scaled.data());
+}
+
+template <typename S, bool Periodic>
+PERLIN_TARGET static size_t derivLoop(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, typename S::Real* dx, typename S::Real* dy, typename S::Real* dz,
+        size_t n, const int* period)
+{
+    typename S::V g[3];
+    size_t i = 0;
+    for(; i + S::N <= n; i += S::N)
+    {
+        S::store(out + i, noiseDeriv<S, Periodic>(p, S::load(x + i), S::load(y + i), S::load(z + i),
+                                                  period, g));
+        S::store(dx + i, g[0]);
+        S::store(dy + i, g[1]);
+        S::store(dz + i, g[2]);
+    }
+    return i;
+}
+
+template <typename S>
+PERLIN_TARGET static size_t derivKernel(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, typename S::Real* dx, typename S::Real* dy, typename S::Real* dz,
+        size_t n, const int* period)
+{
+    if(period)
+        return derivLoop<S, true>(p, x, y, z, out, dx, dy, dz, n, period);
+    return derivLoop<S, false>(p, x, y, z, out, dx, dy, dz, n, nullptr);
+}
+
+// octaveLoop with gradients, summed as BasicPerlin::OctavePerlinDeriv
+// does.
+template <typename S, bool Periodic>
+PERLIN_TARGET static size_t octaveDerivLoop(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, typename S::Real* dx, typename S::Real* dy, typename S::Real* dz,
+        size_t n, const typename S::Real* frequency, const typename S::Real* amplitude,
+        int octaves, typename S::Real maxVal, const int* period)
+{
+    typedef typename S::V V;
+
+    size_t i = 0;
+    for(; i + S::N <= n; i += S::N)
+    {
+        V vx = S::load(x + i);
+        V vy = S::load(y + i);
+        V vz = S::load(z + i);
+        V total = S::set1(0);
+        V gradient[3] = { total, total, total };
+        for(int o = 0; o < octaves; ++o)
+        {
+            V f = S::set1(frequency[o]);
+            V g[3];
+            V n = noiseDeriv<S, Periodic>(p, S::mul(vx, f), S::mul(vy, f), S::mul(vz, f),
+                                          Periodic ? period + 3 * o : nullptr, g);
+            total = S::add(total, S::mul(n, S::set1(amplitude[o])));
+            // Chain rule through the frequency scaling.
+            V scale = S::set1(frequency[o] * amplitude[o]);
+            for(int j = 0; j < 3; ++j)
+                gradient[j] = S::add(gradient[j], S::mul(g[j], scale));
+        }
+        V m = S::set1(maxVal);
+        S::store(out + i, S::div(total, m));
+        S::store(dx + i, S::div(gradient[0], m));
+        S::store(dy + i, S::div(gradient[1], m));
+        S::store(dz + i, S::div(gradient[2], m));
+    }
+    return i;
+}
+
+template <typename S>
+PERLIN_TARGET static size_t octaveDerivKernel(const uint8_t* p,
+        const typename S::Real* x, const typename S::Real* y, const typename S::Real* z,
+        typename S::Real* out, typename S::Real* dx, typename S::Real* dy, typename S::Real* dz,
+        size_t n, const typename S::Real* frequency, const typename S::Real* amplitude,
+        int octaves, typename S::Real maxVal, const int* period)
+{
+    if(!period)
+        return octaveDerivLoop<S, false>(p, x, y, z, out, dx, dy, dz, n,
+                                         frequency, amplitude, octaves, maxVal, nullptr);
+    std::vector<int> scaled = scalePeriods(period, frequency, octaves);
+    return octaveDerivLoop<S, true>(p, x, y, z, out, dx, dy, dz, n,
+                                    frequency, amplitude, octaves, maxVal, scaled.data());
+}
@@ -0,0 +1,254 @@
+#include "perlin_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <vector>
+
+#define PERLIN_SSE2 __attribute__((target("sse2")))
+#define PERLIN_AVX2 __attribute__((target("avx2")))
+
+/*
+ * grad() selects two of x, y, z by the low four hash bits and negates
+ * them by bits 0 and 1:
+ *      first term:  x if hash < 8, else y
+ *      second term: y if hash < 4, x if hash is 12 or 14, else z
+ * which is the same table as the switch in BasicPerlin::grad.
+ *
+ * Double kernels widen each 32-bit hash to a 64-bit lane to build masks;
+ * float kernels use the hash lanes as they are, so they process twice as
+ * many points per register.
+ */
+
+struct Sse2Double
+{
+    typedef double Real;
+    typedef __m128d V;
+    enum { N = 2 };
+
+    PERLIN_SSE2 static V load(const double* a) { return _mm_loadu_pd(a); }
+    PERLIN_SSE2 static void store(double* a, V v) { _mm_storeu_pd(a, v); }
+    PERLIN_SSE2 static V set1(double s) { return _mm_set1_pd(s); }
+    PERLIN_SSE2 static V add(V a, V b) { return _mm_add_pd(a, b); }
+    PERLIN_SSE2 static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    PERLIN_SSE2 static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    PERLIN_SSE2 static V div(V a, V b) { return _mm_div_pd(a, b); }
+
+    // Truncates toward zero like (int)v, stores the integers to lanes and
+    // returns them converted back.
+    PERLIN_SSE2 static V trunc(V v, int* lanes)
+    {
+        __m128i i = _mm_cvttpd_epi32(v);
+        _mm_storel_epi64((__m128i*)lanes, i);
+        return _mm_cvtepi32_pd(i);
+    }
+
+    PERLIN_SSE2 static V select(V mask, V a, V b)
+    {
+        return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+    }
+
+    PERLIN_SSE2 static V grad(const int* hash, V x, V y, V z)
+    {
+        // Duplicate each 32-bit hash into both halves of its 64-bit lane so
+        // 32-bit compares yield full-width masks.
+        __m128i h = _mm_loadl_epi64((const __m128i*)hash);
+        h = _mm_unpacklo_epi32(h, h);
+        __m128i zero = _mm_setzero_si128();
+        V aIsX = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(8)), zero));
+        V bIsY = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(12)), zero));
+        V bIsX = _mm_castsi128_pd(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(13)), _mm_set1_epi32(12)));
+        V signA = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(h, _mm_set1_epi32(1)), 63));
+        V signB = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(h, _mm_set1_epi32(2)), 62));
+        V a = select(aIsX, x, y);
+        V b = select(bIsY, y, select(bIsX, x, z));
+        return _mm_add_pd(_mm_xor_pd(a, signA), _mm_xor_pd(b, signB));
+    }
+};
+
+struct Avx2Double
+{
+    typedef double Real;
+    typedef __m256d V;
+    enum { N = 4 };
+
+    PERLIN_AVX2 static V load(const double* a) { return _mm256_loadu_pd(a); }
+    PERLIN_AVX2 static void store(double* a, V v) { _mm256_storeu_pd(a, v); }
+    PERLIN_AVX2 static V set1(double s) { return _mm256_set1_pd(s); }
+    PERLIN_AVX2 static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    PERLIN_AVX2 static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    PERLIN_AVX2 static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    PERLIN_AVX2 static V div(V a, V b) { return _mm256_div_pd(a, b); }
+
+    PERLIN_AVX2 static V trunc(V v, int* lanes)
+    {
+        __m128i i = _mm256_cvttpd_epi32(v);
+        _mm_storeu_si128((__m128i*)lanes, i);
+        return _mm256_cvtepi32_pd(i);
+    }
+
+    PERLIN_AVX2 static V grad(const int* hash, V x, V y, V z)
+    {
+        __m256i h = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)hash));
+        __m256i zero = _mm256_setzero_si256();
+        V aIsX = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(8)), zero));
+        V bIsY = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(12)), zero));
+        V bIsX = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(13)), _mm256_set1_epi64x(12)));
+        V signA = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(1)), 63));
+        V signB = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(h, _mm256_set1_epi64x(2)), 62));
+        V a = _mm256_blendv_pd(y, x, aIsX);
+        V b = _mm256_blendv_pd(_mm256_blendv_pd(z, x, bIsX), y, bIsY);
+        return _mm256_add_pd(_mm256_xor_pd(a, signA), _mm256_xor_pd(b, signB));
+    }
+};
+
+struct Sse2Float
+{
+    typedef float Real;
+    typedef __m128 V;
+    enum { N = 4 };
+
+    PERLIN_SSE2 static V load(const float* a) { return _mm_loadu_ps(a); }
+    PERLIN_SSE2 static void store(float* a, V v) { _mm_storeu_ps(a, v); }
+    PERLIN_SSE2 static V set1(float s) { return _mm_set1_ps(s); }
+    PERLIN_SSE2 static V add(V a, V b) { return _mm_add_ps(a, b); }
+    PERLIN_SSE2 static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    PERLIN_SSE2 static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    PERLIN_SSE2 static V div(V a, V b) { return _mm_div_ps(a, b); }
+
+    PERLIN_SSE2 static V trunc(V v, int* lanes)
+    {
+        __m128i i = _mm_cvttps_epi32(v);
+        _mm_storeu_si128((__m128i*)lanes, i);
+        return _mm_cvtepi32_ps(i);
+    }
+
+    PERLIN_SSE2 static V select(V mask, V a, V b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    PERLIN_SSE2 static V grad(const int* hash, V x, V y, V z)
+    {
+        __m128i h = _mm_loadu_si128((const __m128i*)hash);
+        __m128i zero = _mm_setzero_si128();
+        V aIsX = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(8)), zero));
+        V bIsY = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(12)), zero));
+        V bIsX = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(13)), _mm_set1_epi32(12)));
+        V signA = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+        V signB = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+        V a = select(aIsX, x, y);
+        V b = select(bIsY, y, select(bIsX, x, z));
+        return _mm_add_ps(_mm_xor_ps(a, signA), _mm_xor_ps(b, signB));
+    }
+};
+
+struct Avx2Float
+{
+    typedef float Real;
+    typedef __m256 V;
+    enum { N = 8 };
+
+    PERLIN_AVX2 static V load(const float* a) { return _mm256_loadu_ps(a); }
+    PERLIN_AVX2 static void store(float* a, V v) { _mm256_storeu_ps(a, v); }
+    PERLIN_AVX2 static V set1(float s) { return _mm256_set1_ps(s); }
+    PERLIN_AVX2 static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    PERLIN_AVX2 static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    PERLIN_AVX2 static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    PERLIN_AVX2 static V div(V a, V b) { return _mm256_div_ps(a, b); }
+
+    PERLIN_AVX2 static V trunc(V v, int* lanes)
+    {
+        __m256i i = _mm256_cvttps_epi32(v);
+        _mm256_storeu_si256((__m256i*)lanes, i);
+        return _mm256_cvtepi32_ps(i);
+    }
+
+    PERLIN_AVX2 static V grad(const int* hash, V x, V y, V z)
+    {
+        __m256i h = _mm256_loadu_si256((const __m256i*)hash);
+        __m256i zero = _mm256_setzero_si256();
+        V aIsX = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(h, _mm256_set1_epi32(8)), zero));
+        V bIsY = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(h, _mm256_set1_epi32(12)), zero));
+        V bIsX = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(h, _mm256_set1_epi32(13)), _mm256_set1_epi32(12)));
+        V signA = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+        V signB = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+        V a = _mm256_blendv_ps(y, x, aIsX);
+        V b = _mm256_blendv_ps(_mm256_blendv_ps(z, x, bIsX), y, bIsY);
+        return _mm256_add_ps(_mm256_xor_ps(a, signA), _mm256_xor_ps(b, signB));
+    }
+};
+
+namespace sse2 {
+#define PERLIN_TARGET PERLIN_SSE2
+#include "perlin_kernel.inl"
+#undef PERLIN_TARGET
+}
+
+namespace avx2 {
+#define PERLIN_TARGET PERLIN_AVX2
+#include "perlin_kernel.inl"
+#undef PERLIN_TARGET
+}
+
+template <>
+PerlinKernels<double> perlinKernelsFor<double>(PerlinIsa isa)
+{
+    PerlinKernels<double> k = { nullptr, nullptr, nullptr, nullptr };
+    __builtin_cpu_init();
+    if(isa == kPerlinAvx2 && __builtin_cpu_supports("avx2"))
+    {
+        k.batch = avx2::perlinKernel<Avx2Double>;
+        k.octaves = avx2::octaveKernel<Avx2Double>;
+        k.deriv = avx2::derivKernel<Avx2Double>;
+        k.octaveDeriv = avx2::octaveDerivKernel<Avx2Double>;
+    }
+    else if(isa == kPerlinSse2 && __builtin_cpu_supports("sse2"))
+    {
+        k.batch = sse2::perlinKernel<Sse2Double>;
+        k.octaves = sse2::octaveKernel<Sse2Double>;
+        k.deriv = sse2::derivKernel<Sse2Double>;
+        k.octaveDeriv = sse2::octaveDerivKernel<Sse2Double>;
+    }
+    return k;
+}
+
+template <>
+PerlinKernels<float> perlinKernelsFor<float>(PerlinIsa isa)
+{
+    PerlinKernels<float> k = { nullptr, nullptr, nullptr, nullptr };
+    __builtin_cpu_init();
+    if(isa == kPerlinAvx2 && __builtin_cpu_supports("avx2"))
+    {
+        k.batch = avx2::perlinKernel<Avx2Float>;
+        k.octaves = avx2::octaveKernel<Avx2Float>;
+        k.deriv = avx2::derivKernel<Avx2Float>;
+        k.octaveDeriv = avx2::octaveDerivKernel<Avx2Float>;
+    }
+    else if(isa == kPerlinSse2 && __builtin_cpu_supports("sse2"))
+    {
+        k.batch = sse2::perlinKernel<Sse2Float>;
+        k.octaves = sse2::octaveKernel<Sse2Float>;
+        k.deriv = sse2::derivKernel<Sse2Float>;
+        k.octaveDeriv = sse2::octaveDerivKernel<Sse2Float>;
+    }
+    return k;
+}
+
+#else
+
+template <>
+PerlinKernels<double> perlinKernelsFor<double>(PerlinIsa)
+{
+    PerlinKernels<double> k = { nullptr, nullptr, nullptr, nullptr };
+    return k;
+}
+
+template <>
+PerlinKernels<float> perlinKernelsFor<float>(PerlinIsa)
+{
+    PerlinKernels<float> k = { nullptr, nullptr, nullptr, nullptr };
+    return k;
+}
+
+#endif
@@ -0,0 +1,87 @@
+// Vectorized kernels behind BasicPerlin::perlinBatch and its variants.
+
+#ifndef PERLIN_SIMD_H
+#define PERLIN_SIMD_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+// A kernel evaluates as many whole SIMD vectors as fit in n points and
+// returns how many it wrote; the caller finishes the tail with the scalar
+// BasicPerlin::perlin. p is the 512 entry PermutationTable. A non-null
+// period makes it BasicPerlin::perlinPeriodic with that period instead.
+template <typename Real>
+using PerlinBatchKernel = size_t (*)(const uint8_t* p,
+        const Real* x, const Real* y, const Real* z,
+        Real* out, size_t n, const int* period);
+
+// Fused fractal kernel: sums octaves of noise at x * frequency[i] scaled by
+// amplitude[i] and divides by maxVal, all octaves per group of points in
+// one pass. With a period, octave i repeats every period * frequency[i]
+// cells, as in BasicPerlin::OctavePerlinPeriodic. Same contract as
+// PerlinBatchKernel otherwise.
+// period * frequency, the period of an octave in its own cells, saturated
+// at INT_MAX. No int lattice index reaches that, so a longer period would
+// wrap nothing either; many octaves of a large period overflow int
+// otherwise.
+inline int octavePeriod(int period, double frequency)
+{
+    double scaled = period * frequency;
+    return scaled < INT_MAX ? (int)scaled : INT_MAX;
+}
+
+template <typename Real>
+using PerlinOctaveKernel = size_t (*)(const uint8_t* p,
+        const Real* x, const Real* y, const Real* z,
+        Real* out, size_t n,
+        const Real* frequency, const Real* amplitude,
+        int octaves, Real maxVal, const int* period);
+
+// PerlinBatchKernel with gradients, as BasicPerlin::perlinDeriv or, with
+// a period, perlinPeriodicDeriv: d/dx, d/dy and d/dz of each value go to
+// dx, dy and dz.
+template <typename Real>
+using PerlinDerivKernel = size_t (*)(const uint8_t* p,
+        const Real* x, const Real* y, const Real* z,
+        Real* out, Real* dx, Real* dy, Real* dz, size_t n, const int* period);
+
+// PerlinOctaveKernel with gradients, as BasicPerlin::OctavePerlinDeriv or
+// OctavePerlinPeriodicDeriv.
+template <typename Real>
+using PerlinOctaveDerivKernel = size_t (*)(const uint8_t* p,
+        const Real* x, const Real* y, const Real* z,
+        Real* out, Real* dx, Real* dy, Real* dz, size_t n,
+        const Real* frequency, const Real* amplitude,
+        int octaves, Real maxVal, const int* period);
+
+template <typename Real>
+struct PerlinKernels
+{
+    PerlinBatchKernel<Real> batch;
+    PerlinOctaveKernel<Real> octaves;
+    PerlinDerivKernel<Real> deriv;
+    PerlinOctaveDerivKernel<Real> octaveDeriv;
+};
+
+// Instruction sets kernels are built for, narrowest first.
+enum PerlinIsa { kPerlinScalar, kPerlinSse2, kPerlinAvx2 };
+
+// The kernels for one instruction set; members are nullptr if the running
+// CPU lacks it, and always for kPerlinScalar. Lets tests cover every path
+// rather than only the widest. Specialized for float and double.
+template <typename Real>
+PerlinKernels<Real> perlinKernelsFor(PerlinIsa isa);
+
+// Picks the widest kernels the running CPU supports; members are nullptr
+// if there is none and the scalar path should be used.
+template <typename Real>
+PerlinKernels<Real> selectPerlinKernels()
+{
+    PerlinKernels<Real> k = perlinKernelsFor<Real>(kPerlinAvx2);
+    if(!k.batch)
+        k = perlinKernelsFor<Real>(kPerlinSse2);
+    return k;
+}
+
+#endif
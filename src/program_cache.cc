@@ -0,0 +1,163 @@
+#include <GL/glew.h>
+#include "program_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sys/stat.h>
+#include <debuggl.h>
+
+namespace {
+
+// FNV-1a, 64 bit.
+const uint64_t kFnvOffset = 14695981039346656037ull;
+const uint64_t kFnvPrime = 1099511628211ull;
+
+// Start of every cache file, followed by the binary itself.
+struct FileHeader {
+	char magic[4];
+	uint32_t format;
+	uint64_t key;
+};
+const char kMagic[4] = { 'P', 'G', 'B', '1' };
+
+}
+
+void ProgramCache::setDirectory(const std::string& dir)
+{
+	directory_ = dir;
+	if (!directory_.empty())
+		mkdir(directory_.c_str(), 0755);
+}
+
+uint64_t ProgramCache::key()
+{
+	static uint64_t driver = 0;
+	if (!driver) {
+		driver = kFnvOffset;
+		GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (GLenum name : names)
+			driver = mix(driver, (const char*)glGetString(name));
+	}
+	return driver;
+}
+
+uint64_t ProgramCache::mix(uint64_t key, const void* data, size_t bytes)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < bytes; i++)
+		key = (key ^ p[i]) * kFnvPrime;
+	return key;
+}
+
+uint64_t ProgramCache::mix(uint64_t key, const char* s)
+{
+	int64_t length = s ? int64_t(strlen(s)) : -1;
+	key = mix(key, &length, sizeof(length));
+	return s ? mix(key, s, length) : key;
+}
+
+bool ProgramCache::supported()
+{
+	if (!GLEW_ARB_get_program_binary)
+		return false;
+	GLint formats = 0;
+	CHECK_GL_ERROR(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+	return formats > 0;
+}
+
+std::string ProgramCache::path(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return directory_ + "/" + name;
+}
+
+void ProgramCache::prepare(unsigned program)
+{
+	if (supported())
+		CHECK_GL_ERROR(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+}
+
+bool ProgramCache::load(unsigned program, uint64_t key)
+{
+	if (!supported())
+		return false;
+	auto iter = binaries_.find(key);
+	if (iter == binaries_.end() && !directory_.empty()) {
+		std::ifstream in(path(key), std::ios::binary);
+		FileHeader header;
+		if (in.read((char*)&header, sizeof(header)) &&
+		    memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+		    header.key == key) {
+			Binary binary;
+			binary.format = header.format;
+			binary.data.assign(std::istreambuf_iterator<char>(in),
+			                   std::istreambuf_iterator<char>());
+			iter = binaries_.emplace(key, std::move(binary)).first;
+		}
+	}
+	if (iter == binaries_.end())
+		return false;
+
+	// An error still queued comes from an earlier call; report it here,
+	// since the check below must only see glProgramBinary's own.
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR)
+		std::cerr << __func__ << ": OpenGL error before loading a program binary: "
+		          << DebugGLErrorToString(int(error)) << std::endl;
+
+	// A driver that no longer accepts the binary raises an error or
+	// leaves the program unlinked; that is a miss, not a failure.
+	const Binary& binary = iter->second;
+	glProgramBinary(program, binary.format, binary.data.data(), binary.data.size());
+	error = glGetError();
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (error == GL_NO_ERROR && status == GL_TRUE)
+		return true;
+	std::cerr << __func__ << ": dropping stale program binary " << path(key) << std::endl;
+	binaries_.erase(iter);
+	if (!directory_.empty())
+		remove(path(key).c_str());
+	return false;
+}
+
+void ProgramCache::store(unsigned program, uint64_t key)
+{
+	if (!supported())
+		return;
+	GLint length = 0;
+	CHECK_GL_ERROR(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+	if (length <= 0)
+		return;
+	Binary binary;
+	binary.data.resize(length);
+	GLenum format = 0;
+	CHECK_GL_ERROR(glGetProgramBinary(program, length, nullptr, &format, binary.data.data()));
+	binary.format = format;
+
+	if (!directory_.empty()) {
+		// Written under a temporary name and renamed, so a concurrent or
+		// interrupted run never reads half a file.
+		std::string final_path = path(key);
+		std::string temp_path = final_path + ".tmp";
+		std::ofstream out(temp_path, std::ios::binary);
+		FileHeader header;
+		memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.format = format;
+		header.key = key;
+		out.write((const char*)&header, sizeof(header));
+		out.write(binary.data.data(), binary.data.size());
+		out.close();
+		if (out)
+			rename(temp_path.c_str(), final_path.c_str());
+		else
+			remove(temp_path.c_str());
+	}
+	binaries_[key] = std::move(binary);
+}
+
+std::string ProgramCache::directory_;
+std::unordered_map<uint64_t, ProgramCache::Binary> ProgramCache::binaries_;
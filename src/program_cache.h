@@ -0,0 +1,55 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * ProgramCache: linked program binaries by content, so a program that was
+ * linked before, in this run or (with a directory) an earlier one, is
+ * loaded with glProgramBinary instead of compiled and linked again.
+ *
+ * A key hashes everything the link depends on. The caller mixes in the
+ * shader sources and the attribute and output locations; key() starts
+ * from the GL vendor, renderer and version, so a driver update misses
+ * instead of loading a stale binary. A driver may still reject a binary,
+ * in which case load() drops it and reports a miss.
+ *
+ * Needs ARB_get_program_binary (core since GL 4.1); without it every
+ * load() misses and store() does nothing.
+ */
+class ProgramCache {
+public:
+	// setDirectory: also keep binaries in dir, which is created if
+	// missing. Empty (the default) keeps them in memory only.
+	static void setDirectory(const std::string& dir);
+
+	// Key of the current driver; mix() in the program's inputs.
+	static uint64_t key();
+	static uint64_t mix(uint64_t key, const void* data, size_t bytes);
+	// Strings are mixed with their length, nullptr as a distinct value.
+	static uint64_t mix(uint64_t key, const char* s);
+
+	// prepare: call before glLinkProgram so that the driver keeps the
+	// binary retrievable for store().
+	static void prepare(unsigned program);
+	// load: link program from the binary cached under key. Returns false
+	// if there is none; program is then unchanged.
+	static bool load(unsigned program, uint64_t key);
+	// store: cache the binary of a successfully linked program.
+	static void store(unsigned program, uint64_t key);
+private:
+	struct Binary {
+		unsigned format;
+		std::vector<char> data;
+	};
+	static bool supported();
+	static std::string path(uint64_t key);
+
+	static std::string directory_;
+	static std::unordered_map<uint64_t, Binary> binaries_;
+};
+
+#endif
@@ -1,9 +1,25 @@
 #include <GL/glew.h>
 #include "render_pass.h"
+#include "gpu_timer.h"
+#include "program_cache.h"
+#include "uniform_block.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <debuggl.h>
 #include <map>
 
+namespace {
+
+// Layout glMultiDrawElementsIndirect reads.
+struct DrawElementsIndirectCommand {
+	GLuint count, instanceCount, firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+}
+
 /*
  * For students:
  * 
@@ -40,29 +56,40 @@ RenderPass::RenderPass(int vao, // -1: create new VAO, otherwise use given VAO
 	  )
 	: vao_(vao), input_(input), uniforms_(uniforms)
 {
+	static int passes = 0;
+	timer_section_ = GpuTimer::section("pass " + std::to_string(passes++));
 	if (vao_ < 0) {
 		CHECK_GL_ERROR(glGenVertexArrays(1, (GLuint*)&vao_));
+		owns_vao_ = true;
 	}
 	CHECK_GL_ERROR(glBindVertexArray(vao_));
 
-	// Program first
-	vs_ = compileShader(shaders[0], GL_VERTEX_SHADER);
-	gs_ = compileShader(shaders[1], GL_GEOMETRY_SHADER);
-	fs_ = compileShader(shaders[2], GL_FRAGMENT_SHADER);
+	// Program first. Shaders are only compiled if ProgramCache misses,
+	// but everything the link depends on goes into its key.
 	CHECK_GL_ERROR(sp_ = glCreateProgram());
-	glAttachShader(sp_, vs_);
-	glAttachShader(sp_, fs_);
-	if (shaders[1])
-		glAttachShader(sp_, gs_);
+	uint64_t key = ProgramCache::key();
+	for (int i = 0; i < 3; i++)
+		key = ProgramCache::mix(key, shaders[i]);
+	// The material index attribute goes after the input's attributes.
+	if (input.hasMaterial()) {
+		material_id_position_ = 0;
+		for (int i = 0; i < input.getNBuffers(); i++)
+			material_id_position_ = std::max(material_id_position_,
+					input.getBufferMeta(i).position + 1);
+		CHECK_GL_ERROR(glBindAttribLocation(sp_, material_id_position_, "material_id"));
+		key = ProgramCache::mix(key, &material_id_position_, sizeof(material_id_position_));
+	}
 
 	// ... and then buffers
 	size_t nbuffer = input.getNBuffers();
 	if (input.hasIndex())
 		nbuffer++;
 	glbuffers_.resize(nbuffer);
+	glbuffer_bytes_.resize(nbuffer);
 	CHECK_GL_ERROR(glGenBuffers(nbuffer, glbuffers_.data()));
 	for (int i = 0; i < input.getNBuffers(); i++) {
 		auto meta = input.getBufferMeta(i);
+		glbuffer_bytes_[i] = meta.getElementSize() * meta.nelements;
 		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glbuffers_[i]));
 		CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
 				meta.getElementSize() * meta.nelements,
@@ -75,42 +102,71 @@ RenderPass::RenderPass(int vao, // -1: create new VAO, otherwise use given VAO
 		CHECK_GL_ERROR(glEnableVertexAttribArray(meta.position));
 		// ... because we need program to bind location
 		CHECK_GL_ERROR(glBindAttribLocation(sp_, meta.position, meta.name.c_str()));
+		key = ProgramCache::mix(key, &meta.position, sizeof(meta.position));
+		key = ProgramCache::mix(key, meta.name.c_str());
 	}
 	// .. bind output position
 	for (size_t i = 0; i < output.size(); i++) {
 		CHECK_GL_ERROR(glBindFragDataLocation(sp_, i, output[i]));
+		key = ProgramCache::mix(key, output[i]);
 	}
 	// ... then we can link
-	glLinkProgram(sp_);
-	CHECK_GL_PROGRAM_ERROR(sp_);
+	if (!ProgramCache::load(sp_, key)) {
+		vs_ = compileShader(shaders[0], GL_VERTEX_SHADER);
+		gs_ = compileShader(shaders[1], GL_GEOMETRY_SHADER);
+		fs_ = compileShader(shaders[2], GL_FRAGMENT_SHADER);
+		glAttachShader(sp_, vs_);
+		glAttachShader(sp_, fs_);
+		if (shaders[1])
+			glAttachShader(sp_, gs_);
+		ProgramCache::prepare(sp_);
+		glLinkProgram(sp_);
+		CHECK_GL_PROGRAM_ERROR(sp_);
+		ProgramCache::store(sp_, key);
+	}
+	bindUniformBlocks();
 
 	if (input.hasIndex()) {
 		auto meta = input.getIndexMeta();
 		CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
 					glbuffers_.back()
 					));
+		glbuffer_bytes_.back() = meta.getElementSize() * meta.nelements;
 		CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 					meta.getElementSize() * meta.nelements,
 					meta.data, GL_STATIC_DRAW));
 	}
 	// after linking uniform locations can be determined
 	unilocs_.resize(uniforms.size());
+	unicache_.resize(uniforms.size());
 	for (size_t i = 0; i < uniforms.size(); i++) {
 		CHECK_GL_ERROR(unilocs_[i] = glGetUniformLocation(sp_, uniforms[i].name.c_str()));
 	}
 	if (input_.hasMaterial()) {
 		createMaterialTexture();
 		initMaterialUniform();
+		createMaterialTable();
+	}
+}
+
+void RenderPass::bindUniformBlocks()
+{
+	GLint nblocks = 0;
+	CHECK_GL_ERROR(glGetProgramiv(sp_, GL_ACTIVE_UNIFORM_BLOCKS, &nblocks));
+	for (GLint i = 0; i < nblocks; i++) {
+		char name[256];
+		CHECK_GL_ERROR(glGetActiveUniformBlockName(sp_, i, sizeof(name), nullptr, name));
+		int binding = UniformBlock::findBinding(name);
+		if (binding < 0)
+			throw __func__+std::string(": error, no UniformBlock named ")+name;
+		CHECK_GL_ERROR(glUniformBlockBinding(sp_, i, binding));
 	}
 }
 
 void RenderPass::initMaterialUniform()
 {
-	auto float_binder = [](int loc, const void* data) {
-		glUniform1fv(loc, 1, (const GLfloat*)data);
-	};
-	auto vector_binder = [](int loc, const void* data) {
-		glUniform4fv(loc, 1, (const GLfloat*)data);
+	auto int_binder = [](int loc, const void* data) {
+		glUniform1iv(loc, 1, (const GLint*)data);
 	};
 	auto sampler0_binder = [](int loc, const void* data) {
 		CHECK_GL_ERROR(glBindSampler(0, (GLuint)(long)data));
@@ -122,19 +178,12 @@ void RenderPass::initMaterialUniform()
 		//std::cerr << " bind texture " << long(data) << std::endl;
 	};
 	material_uniforms_.clear();
+	material_indices_.resize(input_.getNMaterials());
 	for (size_t i = 0; i < input_.getNMaterials(); i++) {
-		auto& ma = input_.getMaterial(i);
-		auto diffuse_data = [&ma]() -> const void* {
-			return &ma.diffuse[0];
-		};
-		auto ambient_data = [&ma]() -> const void* {
-			return &ma.ambient[0];
-		};
-		auto specular_data = [&ma]() -> const void* {
-			return &ma.specular[0];
-		};
-		auto shininess_data = [&ma]() -> const void* {
-			return &ma.shininess;
+		material_indices_[i] = int(i);
+		const int* index = &material_indices_[i];
+		auto base_data = [index]() -> const void* {
+			return index;
 		};
 		int texid = matexids_[i];
 		auto texture_data = [texid]() -> const void* {
@@ -144,24 +193,102 @@ void RenderPass::initMaterialUniform()
 		auto sampler_data = [sam]() -> const void* {
 			return (const void*)(intptr_t)sam;
 		};
-		ShaderUniform diffuse = { "diffuse", vector_binder, diffuse_data };
-		ShaderUniform ambient = { "ambient", vector_binder, ambient_data };
-		ShaderUniform specular = { "specular", vector_binder, specular_data };
-		ShaderUniform shininess = { "shininess", float_binder , shininess_data };
+		ShaderUniform base = { "material_base", int_binder, base_data, sizeof(int) };
 		ShaderUniform texture = { "GL_TEXTURE_2D", texture0_binder , texture_data };
 		ShaderUniform sampler = { "textureSampler", sampler0_binder , sampler_data };
-		std::vector<ShaderUniform> munis = {diffuse, ambient, specular,
-				shininess, texture, sampler};
+		std::vector<ShaderUniform> munis = {base, texture, sampler};
 		material_uniforms_.emplace_back(munis);
 	}
 	malocs_.clear();
-	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "diffuse")));
-	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "ambient")));
-	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "specular")));
-	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "shininess")));
+	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "material_base")));
 	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "textureSampler")));
 	CHECK_GL_ERROR(malocs_.emplace_back(glGetUniformLocation(sp_, "textureSampler")));
 	std::cerr << "textureSampler location: " << malocs_.back() << std::endl;
+	macache_.clear();
+	macache_.resize(malocs_.size());
+	CHECK_GL_ERROR(materials_loc_ = glGetUniformLocation(sp_, "materials"));
+	material_base_loc_ = malocs_[0];
+}
+
+/*
+ * The material table: colors in a buffer texture, the per-instance
+ * material index attribute and, when batching is supported, one indirect
+ * draw command per material, grouped into runs that share a texture.
+ * Expects the pass's VAO to be bound.
+ */
+void RenderPass::createMaterialTable()
+{
+	size_t n = input_.getNMaterials();
+	std::vector<glm::vec4> colors;
+	std::vector<GLint> ids(n);
+	for (size_t i = 0; i < n; i++) {
+		const auto& ma = input_.getMaterial(i);
+		colors.push_back(ma.diffuse);
+		colors.push_back(ma.ambient);
+		colors.push_back(ma.specular);
+		colors.push_back(glm::vec4(ma.shininess, 0.0f, 0.0f, 0.0f));
+		ids[i] = GLint(i);
+	}
+	CHECK_GL_ERROR(glGenBuffers(1, &material_table_));
+	CHECK_GL_ERROR(glBindBuffer(GL_TEXTURE_BUFFER, material_table_));
+	CHECK_GL_ERROR(glBufferData(GL_TEXTURE_BUFFER, colors.size() * sizeof(glm::vec4),
+				colors.data(), GL_STATIC_DRAW));
+	CHECK_GL_ERROR(glGenTextures(1, &material_table_tex_));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_BUFFER, material_table_tex_));
+	CHECK_GL_ERROR(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, material_table_));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_BUFFER, 0));
+	CHECK_GL_ERROR(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+	// Instance i of a draw reads ids[baseInstance + i]; plain draws
+	// read ids[0], which is 0.
+	CHECK_GL_ERROR(glGenBuffers(1, &material_ids_));
+	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, material_ids_));
+	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLint),
+				ids.data(), GL_STATIC_DRAW));
+	if (material_id_position_ >= 0) {
+		CHECK_GL_ERROR(glVertexAttribIPointer(material_id_position_, 1, GL_INT, 0, 0));
+		CHECK_GL_ERROR(glVertexAttribDivisor(material_id_position_, 1));
+		CHECK_GL_ERROR(glEnableVertexAttribArray(material_id_position_));
+	}
+
+	material_runs_.clear();
+	if (!GLEW_ARB_multi_draw_indirect || !GLEW_ARB_base_instance)
+		return;
+	std::vector<DrawElementsIndirectCommand> commands;
+	for (size_t i = 0; i < n; i++) {
+		const auto& ma = input_.getMaterial(i);
+		commands.push_back({ GLuint(ma.nfaces * 3), 1, GLuint(ma.offset * 3), 0, GLuint(i) });
+		if (i == 0 || matexids_[i] != matexids_[i - 1])
+			material_runs_.push_back({ int(i), 0 });
+		material_runs_.back().count++;
+	}
+	CHECK_GL_ERROR(glGenBuffers(1, &indirect_));
+	CHECK_GL_ERROR(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_));
+	CHECK_GL_ERROR(glBufferData(GL_DRAW_INDIRECT_BUFFER,
+				commands.size() * sizeof(DrawElementsIndirectCommand),
+				commands.data(), GL_STATIC_DRAW));
+	CHECK_GL_ERROR(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+}
+
+void RenderPass::releaseMaterialTable()
+{
+	if (material_table_tex_)
+		CHECK_GL_ERROR(glDeleteTextures(1, &material_table_tex_));
+	unsigned buffers[] = { material_table_, material_ids_, indirect_ };
+	for (unsigned buffer : buffers)
+		if (buffer)
+			CHECK_GL_ERROR(glDeleteBuffers(1, &buffer));
+	material_table_tex_ = material_table_ = material_ids_ = indirect_ = 0;
+	material_runs_.clear();
+}
+
+// The table goes on texture unit 1; unit 0 has the material's texture.
+void RenderPass::bindMaterialTable()
+{
+	CHECK_GL_ERROR(glActiveTexture(GL_TEXTURE0 + 1));
+	CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_BUFFER, material_table_tex_));
+	CHECK_GL_ERROR(glActiveTexture(GL_TEXTURE0 + 0));
+	CHECK_GL_ERROR(glUniform1i(materials_loc_, 1));
 }
 
 /*
@@ -220,6 +347,7 @@ void RenderPass::createMaterialTexture()
 			" dim: " << w << " x " << h << std::endl;
 		CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, 0));
 		matexids_.emplace_back(tex);
+		gltextures_.emplace_back(tex);
 		tex2id[ma.texture.get()] = tex;
 	}
 	CHECK_GL_ERROR(glGenSamplers(1, &sampler2d_));
@@ -229,65 +357,194 @@ void RenderPass::createMaterialTexture()
 	CHECK_GL_ERROR(glSamplerParameteri(sampler2d_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
 }
 
+void RenderPass::releaseMaterialTexture()
+{
+	if (!gltextures_.empty())
+		CHECK_GL_ERROR(glDeleteTextures(gltextures_.size(), gltextures_.data()));
+	gltextures_.clear();
+	matexids_.clear();
+	if (sampler2d_)
+		CHECK_GL_ERROR(glDeleteSamplers(1, &sampler2d_));
+	sampler2d_ = 0;
+}
+
 RenderPass::~RenderPass()
 {
-	// TODO: Free resources
+	releaseMaterialTable();
+	releaseMaterialTexture();
+	if (!glbuffers_.empty())
+		CHECK_GL_ERROR(glDeleteBuffers(glbuffers_.size(), glbuffers_.data()));
+	// Attached shaders are only flagged by glDeleteShader, and we never
+	// call that on cached shaders, so deleting the program is enough.
+	CHECK_GL_ERROR(glDeleteProgram(sp_));
+	if (owns_vao_)
+		CHECK_GL_ERROR(glDeleteVertexArrays(1, (GLuint*)&vao_));
 }
 
-void RenderPass::updateVBO(int position, const void* data, size_t size)
+void RenderPass::uploadBuffer(int target, unsigned buffer, size_t& allocated,
+		const void* data, size_t bytes)
+{
+	CHECK_GL_ERROR(glBindBuffer(target, buffer));
+	if (bytes == allocated) {
+		CHECK_GL_ERROR(glBufferSubData(target, 0, bytes, data));
+		return;
+	}
+	// Buffers that get resized are likely to be updated again.
+	CHECK_GL_ERROR(glBufferData(target, bytes, data, GL_DYNAMIC_DRAW));
+	allocated = bytes;
+}
+
+void RenderPass::rebind(const RenderDataInput& input)
 {
-	int bufferid = -1;
+	if (input.getNBuffers() != input_.getNBuffers() ||
+	    input.hasIndex() != input_.hasIndex())
+		throw __func__+std::string(": error, input layout differs from the pass");
+	for (int i = 0; i < input.getNBuffers(); i++) {
+		if (input.getBufferMeta(i).position != input_.getBufferMeta(i).position)
+			throw __func__+std::string(": error, buffer position mismatch at ")+std::to_string(i);
+	}
+	input_ = input;
+
+	// The element buffer binding is VAO state.
+	CHECK_GL_ERROR(glBindVertexArray(vao_));
 	for (int i = 0; i < input_.getNBuffers(); i++) {
 		auto meta = input_.getBufferMeta(i);
-		if (meta.position == position) {
-			bufferid = i;
-			break;
-		}
+		uploadBuffer(GL_ARRAY_BUFFER, glbuffers_[i], glbuffer_bytes_[i],
+				meta.data, meta.getElementSize() * meta.nelements);
+	}
+	if (input_.hasIndex()) {
+		auto meta = input_.getIndexMeta();
+		uploadBuffer(GL_ELEMENT_ARRAY_BUFFER, glbuffers_.back(),
+				glbuffer_bytes_.back(),
+				meta.data, meta.getElementSize() * meta.nelements);
+	}
+	releaseMaterialTable();
+	releaseMaterialTexture();
+	material_uniforms_.clear();
+	if (input_.hasMaterial()) {
+		createMaterialTexture();
+		initMaterialUniform();
+		createMaterialTable();
 	}
-	if (bufferid < 0)
-		throw __func__+std::string(": error, can't find buffer with position ")+std::to_string(position);
+}
+
+int RenderPass::findBuffer(int position) const
+{
+	for (int i = 0; i < input_.getNBuffers(); i++) {
+		auto meta = input_.getBufferMeta(i);
+		if (meta.position == position)
+			return i;
+	}
+	throw __func__+std::string(": error, can't find buffer with position ")+std::to_string(position);
+}
+
+void RenderPass::updateVBO(int position, const void* data, size_t size)
+{
+	int bufferid = findBuffer(position);
 	auto meta = input_.getBufferMeta(bufferid);
+	uploadBuffer(GL_ARRAY_BUFFER, glbuffers_[bufferid],
+			glbuffer_bytes_[bufferid],
+			data, size * meta.getElementSize());
+}
+
+void RenderPass::updateVBORange(int position, size_t first, const void* data, size_t size)
+{
+	int bufferid = findBuffer(position);
+	size_t element_size = input_.getBufferMeta(bufferid).getElementSize();
+	if ((first + size) * element_size > glbuffer_bytes_[bufferid])
+		throw __func__+std::string(": error, range exceeds buffer with position ")+std::to_string(position);
 	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glbuffers_[bufferid]));
-	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-				size * meta.getElementSize(),
-				data, GL_STATIC_DRAW));
+	CHECK_GL_ERROR(glBufferSubData(GL_ARRAY_BUFFER, first * element_size,
+				size * element_size, data));
+}
+
+void RenderPass::setName(const std::string& name)
+{
+	timer_section_ = GpuTimer::section(name);
 }
 
 void RenderPass::setup()
 {
+	GpuTimer::begin(timer_section_);
 	// Switch to our object VAO.
 	CHECK_GL_ERROR(glBindVertexArray(vao_));
 	// Use our program.
 	CHECK_GL_ERROR(glUseProgram(sp_));
 
-	bind_uniforms(uniforms_, unilocs_);
+	bind_uniforms(uniforms_, unilocs_, unicache_);
 }
 
 bool RenderPass::renderWithMaterial(int mid)
 {
 	if (mid >= material_uniforms_.size() || mid < 0)
 		return false;
-	const auto& mat = input_.getMaterial(mid);
 #if 0
+	const auto& mat = input_.getMaterial(mid);
 	if (!mat.texture)
 		return true;
 #endif
+	bindMaterialTable();
+	drawMaterial(mid);
+	return true;
+}
+
+void RenderPass::drawMaterial(int mid)
+{
+	const auto& mat = input_.getMaterial(mid);
 	auto& matuni = material_uniforms_[mid];
-	bind_uniforms(matuni, malocs_);
+	bind_uniforms(matuni, malocs_, macache_);
 	CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, mat.nfaces * 3,
 				GL_UNSIGNED_INT,
 				(const void*)(mat.offset * 3 * 4)) // Offset is in bytes
 	              );
-	return true;
+}
+
+void RenderPass::renderMaterials()
+{
+	if (material_uniforms_.empty())
+		return;
+	bindMaterialTable();
+	if (material_runs_.empty()) {
+		for (size_t i = 0; i < material_uniforms_.size(); i++)
+			drawMaterial(int(i));
+		return;
+	}
+	// The base instance picks the material, so material_base is 0 and
+	// drawMaterial's cached value is stale afterwards.
+	CHECK_GL_ERROR(glUniform1i(material_base_loc_, 0));
+	macache_[0].clear();
+	CHECK_GL_ERROR(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_));
+	for (const MaterialRun& run : material_runs_) {
+		// Only the texture binds of the run's first material; the rest
+		// share them.
+		auto& matuni = material_uniforms_[run.first];
+		for (size_t i = 1; i < matuni.size(); i++)
+			CHECK_GL_ERROR(matuni[i].binder(malocs_[i], matuni[i].data_source()));
+		CHECK_GL_ERROR(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					(const void*)(run.first * sizeof(DrawElementsIndirectCommand)),
+					run.count, 0));
+	}
+	CHECK_GL_ERROR(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
 }
 
 void RenderPass::bind_uniforms(std::vector<ShaderUniform>& uniforms,
-		const std::vector<unsigned>& unilocs)
+		const std::vector<unsigned>& unilocs,
+		std::vector<std::vector<char>>& cache)
 {
 	for (size_t i = 0; i < uniforms.size(); i++) {
 		const auto& uni = uniforms[i];
+		const void* data = uni.data_source();
+		if (uni.size > 0) {
+			// Not in the program (or optimized out): nothing to set.
+			if (GLint(unilocs[i]) < 0)
+				continue;
+			auto& last = cache[i];
+			if (last.size() == uni.size && memcmp(last.data(), data, uni.size) == 0)
+				continue;
+			last.assign((const char*)data, (const char*)data + uni.size);
+		}
 		//std::cerr << "binding " << uni.name << std::endl;
-		CHECK_GL_ERROR(uni.binder(unilocs[i], uni.data_source()));
+		CHECK_GL_ERROR(uni.binder(unilocs[i], data));
 	}
 }
 
@@ -295,7 +552,10 @@ unsigned RenderPass::compileShader(const char* source_ptr, int type)
 {
 	if (!source_ptr)
 		return 0;
-	auto iter = shader_cache_.find(source_ptr);
+	// Keyed by content, so equal sources at different addresses share a
+	// shader.
+	std::string key = std::to_string(type) + ":" + source_ptr;
+	auto iter = shader_cache_.find(key);
 	if (iter != shader_cache_.end()) {
 		return iter->second;
 	}
@@ -307,7 +567,7 @@ unsigned RenderPass::compileShader(const char* source_ptr, int type)
 	CHECK_GL_ERROR(glShaderSource(ret, 1, &source_ptr, nullptr));
 	glCompileShader(ret);
 	CHECK_GL_SHADER_ERROR(ret);
-	shader_cache_[source_ptr] = ret;
+	shader_cache_[key] = ret;
 	return ret;
 }
 
@@ -345,4 +605,4 @@ size_t RenderInputMeta::getElementSize() const
 	return element_size * element_length;
 }
 
-std::map<const char*, unsigned> RenderPass::shader_cache_;
+std::unordered_map<std::string, unsigned> RenderPass::shader_cache_;
@@ -16,6 +16,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <material.h>
 
@@ -24,6 +25,16 @@
  *      name: name
  *      binder: function to bind the uniform
  *      data_source: function to get the data for the uniform
+ *      size: bytes of data the binder reads, or 0
+ *
+ * Uniform values are program state, so a pass only needs to call binder
+ * when they change. With a size, setup() compares the data with what it
+ * bound last time and skips binder if it is the same. Leave size at 0
+ * for binders with effects outside the program, such as binding a
+ * texture, which must run every time.
+ *
+ * Uniforms every pass shares per frame (camera, light) belong in a
+ * UniformBlock instead.
  */
 struct ShaderUniform {
 	std::string name;
@@ -43,6 +54,7 @@ struct ShaderUniform {
 	 *       the lambda function
 	 */
 	std::function<const void*()> data_source;
+	size_t size;
 };
 
 /*
@@ -123,6 +135,10 @@ public:
 	 *      shaders: array of shaders, leave the second as nullptr if no GS present
 	 *      uniforms: array of ShaderUniform objects
 	 *      output: the FS output variable name.
+	 * Uniform blocks the shaders declare are bound to the UniformBlock of
+	 * the same name, which must exist.
+	 * The program is loaded from ProgramCache when the same shaders and
+	 * locations were linked before, skipping compilation.
 	 * RenderPass does not support render-to-texture or multi-target
 	 * rendering for now (and you also don't need it).
 	 */
@@ -132,11 +148,44 @@ public:
 	           const std::vector<ShaderUniform> uniforms,
 	           const std::vector<const char*> output // Order: 0, 1, 2...
 		  );
+	/*
+	 * The destructor releases the program, buffers, textures, sampler and
+	 * (if the pass created it) the VAO. Shaders are shared through
+	 * shader_cache_ and stay alive.
+	 *
+	 * A pass owns GL objects, so it cannot be copied. Use rebind() or
+	 * updateVBO() to change its data instead of constructing a new pass.
+	 */
 	~RenderPass();
+	RenderPass(const RenderPass&) = delete;
+	RenderPass& operator=(const RenderPass&) = delete;
 
 	unsigned getVAO() const { return unsigned(vao_); }
+	/*
+	 * updateVBO: replace the contents of the buffer bound to position.
+	 * Same-size updates are written in place with glBufferSubData; the
+	 * buffer is only reallocated when the element count changes.
+	 */
 	void updateVBO(int position, const void* data, size_t nelement);
+	/*
+	 * updateVBORange: overwrite elements [first, first + nelement) of
+	 * the buffer bound to position, leaving the rest untouched. The
+	 * range must lie within the buffer.
+	 */
+	void updateVBORange(int position, size_t first, const void* data, size_t nelement);
+	/*
+	 * rebind: upload new data for every buffer of the pass, keeping the
+	 * program and VAO. input must assign the same buffer positions as
+	 * the input given to the constructor. Material textures are
+	 * recreated if input carries materials.
+	 */
+	void rebind(const RenderDataInput& input);
 	void setup();
+	/*
+	 * setName: name the pass's GpuTimer section, "pass N" by default,
+	 * N counting passes in order of creation. setup() begins it.
+	 */
+	void setName(const std::string& name);
 	/*
  	 * Note: here we don't have an unified render() function, because the
 	 * reference solution renders with different primitives
@@ -148,27 +197,66 @@ public:
 	/*
 	 * renderWithMaterial: render a part of vertex buffer, after binding
 	 * corresponding uniforms for Phong shading.
+	 *
+	 * Material colors live in a buffer texture, the "materials" sampler,
+	 * four texels per material (diffuse, ambient, specular, shininess).
+	 * Shaders find theirs at material_base + material_id, material_id
+	 * being a per-instance attribute holding each material's index.
+	 * Here material_base is the material and material_id 0.
 	 */
 	bool renderWithMaterial(int i); // return false if material id is invalid
+	/*
+	 * renderMaterials: render every material, in order. With
+	 * ARB_multi_draw_indirect and ARB_base_instance, each run of
+	 * consecutive materials sharing a texture is one
+	 * glMultiDrawElementsIndirect call, whose base instances select
+	 * material_id. Otherwise it calls renderWithMaterial for each.
+	 */
+	void renderMaterials();
 private:
 	void initMaterialUniform();
 	void createMaterialTexture();
+	void releaseMaterialTexture();
+	void createMaterialTable();
+	void releaseMaterialTable();
+	void bindMaterialTable();
+	void drawMaterial(int mid);
+	int findBuffer(int position) const;
+	static void uploadBuffer(int target, unsigned buffer, size_t& allocated,
+	                         const void* data, size_t bytes);
 
 	int vao_;
+	bool owns_vao_ = false;
 	RenderDataInput input_;
 	std::vector<ShaderUniform> uniforms_;
 	std::vector<std::vector<ShaderUniform>> material_uniforms_;
 
 	std::vector<unsigned> glbuffers_, unilocs_, malocs_;
+	// Data last bound for each tracked uniform, empty until then.
+	std::vector<std::vector<char>> unicache_, macache_;
+	std::vector<size_t> glbuffer_bytes_; // allocated size of each buffer
 	std::vector<unsigned> gltextures_, matexids_;
-	unsigned sampler2d_;
+	unsigned sampler2d_ = 0;
+	// Material table and batched draws, see renderMaterials.
+	struct MaterialRun {
+		int first, count; // commands in indirect_
+	};
+	int material_id_position_ = -1;
+	unsigned material_table_ = 0, material_table_tex_ = 0;
+	unsigned material_ids_ = 0, indirect_ = 0;
+	std::vector<MaterialRun> material_runs_;
+	std::vector<int> material_indices_; // material_base of each material
+	int materials_loc_ = -1, material_base_loc_ = -1;
 	unsigned vs_ = 0, gs_ = 0, fs_ = 0;
 	unsigned sp_ = 0;
+	int timer_section_;
 	
 	static unsigned compileShader(const char*, int type);
-	static std::map<const char*, unsigned> shader_cache_;
+	static std::unordered_map<std::string, unsigned> shader_cache_; // by type and source
 
-	static void bind_uniforms(std::vector<ShaderUniform>& uniforms, const std::vector<unsigned>& unilocs);
+	void bindUniformBlocks();
+	static void bind_uniforms(std::vector<ShaderUniform>& uniforms, const std::vector<unsigned>& unilocs,
+	                          std::vector<std::vector<char>>& cache);
 };
 
 #endif
@@ -5,10 +5,9 @@ in vec4 vertex_normal;
 in vec4 light_direction;
 in vec4 camera_direction;
 in vec2 uv_coords;
-uniform vec4 diffuse;
-uniform vec4 ambient;
-uniform vec4 specular;
-uniform float shininess;
+flat in int material;
+// Four texels per material: diffuse, ambient, specular, shininess.
+uniform samplerBuffer materials;
 uniform float alpha;
 uniform sampler2D textureSampler;
 out vec4 fragment_color;
@@ -17,6 +16,10 @@ float rand(vec2 co){
     return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
 }
 void main() {
+	vec4 diffuse = texelFetch(materials, 4 * material);
+	vec4 ambient = texelFetch(materials, 4 * material + 1);
+	vec4 specular = texelFetch(materials, 4 * material + 2);
+	float shininess = texelFetch(materials, 4 * material + 3).x;
 	vec3 texcolor = texture(textureSampler, uv_coords).xyz;
 	if (length(texcolor) == 0.0) {
 		//vec3 color = vec3(0.0, 1.0, 0.0);
@@ -1,16 +1,24 @@
 R"zzz(
 #version 330 core
-uniform vec4 light_position;
-uniform vec3 camera_position;
+layout(std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 light_position;
+	vec3 camera_position;
+};
 in vec4 vertex_position;
 in vec4 normal;
 in vec2 uv;
 in vec4 color;
+// Material index; see RenderPass::renderWithMaterial.
+in int material_id;
+uniform int material_base;
 out vec4 vs_light_direction;
 out vec4 vs_normal;
 out vec2 vs_uv;
 out vec4 vs_camera_direction;
 out vec4 vs_color;
+flat out int vs_material;
 void main() {
 	gl_Position = vertex_position;
 	vs_light_direction = light_position - gl_Position;
@@ -18,5 +26,6 @@ void main() {
 	vs_normal = normal;
 	vs_uv = uv;
 	vs_color = color;
+	vs_material = material_base + material_id;
 }
 )zzz"
@@ -0,0 +1,127 @@
+R"zzz(
+#version 330 core
+// GLSL port of PerlinF::perlinPeriodic, OctavePerlinPeriodic and
+// HeightField::generate. Each fragment is one grid point: gl_FragCoord is
+// (y, x) in the layout HeightTexture uses. Without a period, period is
+// 256 cells and grid_period exceeds the map, which is perlin() exactly.
+uniform usampler1D permutation;
+uniform ivec2 map_size;
+uniform int slice;
+uniform float noise_scale;
+uniform ivec3 period;
+uniform int grid_period;
+uniform int map_type;
+uniform int octaves;
+uniform float persistence;
+uniform float height_scale;
+uniform float power;
+out float height;
+
+// p[i] of the CPU table, which repeats the 256 entries twice.
+int perm(int i) {
+	return int(texelFetch(permutation, i & 255, 0).r);
+}
+
+float fade(float t) {
+	return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+float lerp(float a, float b, float x) {
+	return a + x * (b - a);
+}
+
+float grad(int hash, float x, float y, float z) {
+	switch (hash & 0xF) {
+	case 0x0: return  x + y;
+	case 0x1: return -x + y;
+	case 0x2: return  x - y;
+	case 0x3: return -x - y;
+	case 0x4: return  x + z;
+	case 0x5: return -x + z;
+	case 0x6: return  x - z;
+	case 0x7: return -x - z;
+	case 0x8: return  y + z;
+	case 0x9: return -y + z;
+	case 0xA: return  y - z;
+	case 0xB: return -y - z;
+	case 0xC: return  y + x;
+	case 0xD: return -y + z;
+	case 0xE: return  y - x;
+	default:  return -y - z;
+	}
+}
+
+float perlin(float x, float y, float z, ivec3 cells) {
+	ivec3 c = ivec3(int(x), int(y), int(z));
+	ivec3 i0 = (c % cells) & 255;
+	ivec3 i1 = ((c + 1) % cells) & 255;
+
+	float xf = x - float(c.x);
+	float yf = y - float(c.y);
+	float zf = z - float(c.z);
+
+	float u = fade(xf);
+	float v = fade(yf);
+	float w = fade(zf);
+
+	int aaa = perm(perm(perm(i0.x) + i0.y) + i0.z);
+	int aba = perm(perm(perm(i0.x) + i1.y) + i0.z);
+	int aab = perm(perm(perm(i0.x) + i0.y) + i1.z);
+	int abb = perm(perm(perm(i0.x) + i1.y) + i1.z);
+	int baa = perm(perm(perm(i1.x) + i0.y) + i0.z);
+	int bba = perm(perm(perm(i1.x) + i1.y) + i0.z);
+	int bab = perm(perm(perm(i1.x) + i0.y) + i1.z);
+	int bbb = perm(perm(perm(i1.x) + i1.y) + i1.z);
+
+	float x1, x2, y1, y2;
+	x1 = lerp(grad(aaa, xf, yf, zf), grad(baa, xf-1.0, yf, zf), u);
+	x2 = lerp(grad(aba, xf, yf-1.0, zf), grad(bba, xf-1.0, yf-1.0, zf), u);
+	y1 = lerp(x1, x2, v);
+	x1 = lerp(grad(aab, xf, yf, zf-1.0), grad(bab, xf-1.0, yf, zf-1.0), u);
+	x2 = lerp(grad(abb, xf, yf-1.0, zf-1.0), grad(bbb, xf-1.0, yf-1.0, zf-1.0), u);
+	y2 = lerp(x1, x2, v);
+
+	return (lerp(y1, y2, w) + 1.0) / 2.0;
+}
+
+float octavePerlin(float x, float y, float z) {
+	float total = 0.0;
+	float frequency = 1.0;
+	float amplitude = 1.0;
+	float maxVal = 0.0;
+	for (int i = 0; i < octaves; ++i) {
+		// Saturated as octavePeriod does on the CPU.
+		ivec3 scaled = ivec3(min(vec3(period) * frequency, 2147483520.0));
+		total += perlin(x * frequency, y * frequency, z * frequency, scaled) * amplitude;
+		maxVal += amplitude;
+		amplitude *= persistence;
+		frequency *= 2.0;
+	}
+	return total / maxVal;
+}
+
+void main() {
+	int y = int(gl_FragCoord.x);
+	int x = int(gl_FragCoord.y);
+	float px = float(x % grid_period) * noise_scale;
+	float py = float(y % grid_period) * noise_scale;
+	float pz = float(slice) * noise_scale;
+	float n = octaves > 0 ? octavePerlin(px, py, pz) : perlin(px, py, pz, period);
+
+	if (map_type == 2) {
+		float xPeriod = 5.0;
+		float yPeriod = 5.0;
+		float val = float(x) * xPeriod / float(map_size.x) +
+		            float(y) * yPeriod / float(map_size.y) + power * n;
+		height = height_scale * abs(sin(val * 3.14159));
+	} else if (map_type == 3) {
+		float period = 5.0;
+		float xVal = float(x - map_size.x / 2) / float(map_size.x);
+		float yVal = float(y - map_size.y / 2) / float(map_size.y);
+		float dist = sqrt(xVal * xVal + yVal * yVal) + power * n;
+		height = height_scale * abs(sin(2.0 * period * dist * 3.14159));
+	} else {
+		height = height_scale * n;
+	}
+}
+)zzz"
@@ -0,0 +1,75 @@
+R"zzz(
+#version 330 core
+layout(std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 light_position;
+	vec3 camera_position;
+};
+uniform mat4 model;
+uniform sampler2D height_map;
+uniform sampler3D height_volume;
+uniform int use_volume;
+uniform float level;
+uniform vec2 height_decode;
+uniform float height_scale;
+uniform vec2 grid_spacing;
+uniform vec2 terrain_origin;
+// xy: world x and z of the patch corner, z: patch size, w: skirt drop
+uniform vec4 node;
+// xy: position in the patch in [0, 1]; z: 1 on skirt vertices
+in vec4 vertex_position;
+out vec4 light_direction;
+out vec4 world_position;
+out vec4 vertex_normal;
+out vec4 vertex_color;
+
+// Height at texel (y, x), clamped to the map.
+float heightAt(ivec2 texel) {
+	if (use_volume != 0) {
+		vec3 size = vec3(textureSize(height_volume, 0));
+		texel = clamp(texel, ivec2(0), ivec2(size.xy) - 1);
+		// Texel centers in x and y, so only the level is interpolated.
+		vec3 coord = (vec3(texel, level) + 0.5) / size;
+		float value = textureLod(height_volume, coord, 0.0).r;
+		return height_decode.x + height_decode.y * value;
+	}
+	texel = clamp(texel, ivec2(0), textureSize(height_map, 0) - 1);
+	return texelFetch(height_map, texel, 0).r;
+}
+
+// Bilinear height at grid coordinates g: x along world x, y along world
+// z, in texels.
+float heightAtGrid(vec2 g) {
+	vec2 base = floor(g + 1e-3);
+	vec2 f = clamp(g - base, 0.0, 1.0);
+	ivec2 texel = ivec2(base.y, base.x);
+	float h00 = heightAt(texel);
+	float h10 = heightAt(texel + ivec2(0, 1));
+	float h01 = heightAt(texel + ivec2(1, 0));
+	float h11 = heightAt(texel + ivec2(1, 1));
+	return mix(mix(h00, h10, f.x), mix(h01, h11, f.x), f.y);
+}
+
+void main() {
+	vec2 world = node.xy + vertex_position.xy * node.z;
+	vec2 g = (world - terrain_origin) / grid_spacing;
+	float height = heightAtGrid(g);
+	float dx = heightAtGrid(g + vec2(1.0, 0.0)) - heightAtGrid(g - vec2(1.0, 0.0));
+	float dz = heightAtGrid(g + vec2(0.0, 1.0)) - heightAtGrid(g - vec2(0.0, 1.0));
+	vec3 normal = normalize(vec3(-dx / (2.0 * grid_spacing.x), 1.0,
+	                             -dz / (2.0 * grid_spacing.y)));
+
+	float y = height - vertex_position.z * node.w;
+	world_position = model * vec4(world.x, y, world.y, 1.0);
+	light_direction = light_position - world_position;
+	vertex_normal = model * vec4(normal, 0.0);
+	gl_Position = projection * view * world_position;
+	if (height >= 0.7 * height_scale)
+		vertex_color = vec4(1.0, 1.0, 1.0, 1.0);
+	else if (height >= 0.45 * height_scale)
+		vertex_color = vec4(0.2, 0.1, 0.0, 1.0);
+	else
+		vertex_color = vec4(0.0, 1.0, 0.0, 1.0);
+}
+)zzz"
@@ -0,0 +1,24 @@
+R"zzz(
+#version 330 core
+layout(std140) uniform PerFrame {
+	mat4 projection;
+	mat4 view;
+	vec4 light_position;
+	vec3 camera_position;
+};
+uniform mat4 model;
+in vec4 vertex_position;
+in vec4 normal;
+in vec4 color;
+out vec4 light_direction;
+out vec4 world_position;
+out vec4 vertex_normal;
+out vec4 vertex_color;
+void main() {
+	world_position = model * vertex_position;
+	light_direction = light_position - world_position;
+	vertex_normal = model * normal;
+	vertex_color = color;
+	gl_Position = projection * view * world_position;
+}
+)zzz"
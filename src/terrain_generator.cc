@@ -0,0 +1,358 @@
+#include "terrain_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+HeightMap::HeightMap(const HeightMapParams& params, int threads)
+	: params_(params), threads_(threads), field_(params),
+	volume_(params.sizeX, params.sizeY, params.sizeZ, params.storage,
+	        0.0f, params.heightScale),
+	state_(new std::atomic<int>[params.sizeZ]),
+	chunk_ranges_(params.sizeZ), slopes_(params.sizeZ)
+{
+	for(int z = 0; z < params.sizeZ; ++z)
+		state_[z] = kEmpty;
+}
+
+void HeightMap::ensureSlice(int z)
+{
+	int expected = kEmpty;
+	if(state_[z].compare_exchange_strong(expected, kBusy))
+	{
+		std::vector<float> values(volume_.sliceSamples());
+		// Slopes come out of the same pass as the heights.
+		std::vector<float>& slopes = slopes_[z];
+		slopes.resize(2 * values.size());
+		field_.generate(0, 0, params_.sizeX, params_.sizeY, z, values.data(), threads_,
+		                slopes.data());
+		volume_.storeSlice(z, values.data());
+
+		// Bound what reads back, not what was generated, so compact
+		// storage rounding cannot step outside a chunk's range.
+		if(volume_.storage() != HeightVolume::kFloat32)
+			volume_.loadSlice(z, values.data());
+		int mapSizeX = params_.sizeX;
+		int mapSizeY = params_.sizeY;
+		std::vector<float>& ranges = chunk_ranges_[z];
+		ranges.resize(2 * chunksX() * chunksY());
+		for(int cx = 0; cx < chunksX(); ++cx)
+		{
+			for(int cy = 0; cy < chunksY(); ++cy)
+			{
+				float lo = values[(size_t)cx * chunkQuads * mapSizeY + cy * chunkQuads];
+				float hi = lo;
+				int x1 = std::min((cx + 1) * chunkQuads, mapSizeX - 1);
+				int y1 = std::min((cy + 1) * chunkQuads, mapSizeY - 1);
+				for(int x = cx * chunkQuads; x <= x1; ++x)
+				{
+					const float* row = &values[(size_t)x * mapSizeY];
+					for(int y = cy * chunkQuads; y <= y1; ++y)
+					{
+						lo = std::min(lo, row[y]);
+						hi = std::max(hi, row[y]);
+					}
+				}
+				ranges[2 * (cx * chunksY() + cy)] = lo;
+				ranges[2 * (cx * chunksY() + cy) + 1] = hi;
+			}
+		}
+		state_[z] = kReady;
+	}
+	while(state_[z] != kReady)
+		std::this_thread::yield();
+}
+
+void HeightMap::readSlice(int z, float* out)
+{
+	ensureSlice(z);
+	volume_.loadSlice(z, out);
+}
+
+void HeightMap::readGradient(int z, float* out)
+{
+	ensureSlice(z);
+	std::copy(slopes_[z].begin(), slopes_[z].end(), out);
+}
+
+float HeightMap::at(int x, int y, int z)
+{
+	ensureSlice(z);
+	return volume_.at(x, y, z);
+}
+
+void HeightMap::chunkRange(int z, int cx, int cy, float& lo, float& hi) const
+{
+	const std::vector<float>& ranges = chunk_ranges_[z];
+	lo = ranges[2 * (cx * chunksY() + cy)];
+	hi = ranges[2 * (cx * chunksY() + cy) + 1];
+}
+
+void HeightMap::range(int z, int x0, int y0, int x1, int y1, float& lo, float& hi) const
+{
+	// Chunks share their border points, so a point on a border may sit in
+	// either neighbour; both are included.
+	int cx0 = std::max(0, (x0 - 1) / chunkQuads);
+	int cy0 = std::max(0, (y0 - 1) / chunkQuads);
+	int cx1 = std::max(0, std::min(chunksX() - 1, x1 / chunkQuads));
+	int cy1 = std::max(0, std::min(chunksY() - 1, y1 / chunkQuads));
+	cx0 = std::min(cx0, cx1);
+	cy0 = std::min(cy0, cy1);
+	chunkRange(z, cx0, cy0, lo, hi);
+	for(int cx = cx0; cx <= cx1; ++cx)
+	{
+		for(int cy = cy0; cy <= cy1; ++cy)
+		{
+			float clo, chi;
+			chunkRange(z, cx, cy, clo, chi);
+			lo = std::min(lo, clo);
+			hi = std::max(hi, chi);
+		}
+	}
+}
+
+HeightField::HeightField(const HeightMapParams& params)
+	: params_(params), noise_(params.seed), octaves_(params.numOctaves, params.persistence),
+	step_(noiseScale)
+{
+	if(params.period > 0)
+	{
+		period_cells_ = std::max(1, (int)std::lround(params.period * noiseScale));
+		step_ = float(period_cells_) / params.period;
+	}
+}
+
+// Fills the region row by row: each x row is one batch of noise along y,
+// then the map type transform is applied in place. With a gradient, the
+// noise's slopes go through the transform by the chain rule.
+void HeightField::generate(int x0, int y0, int sizeX, int sizeY, int z, float* out, int threads,
+		float* gradient) const
+{
+	int mapSizeX = params_.sizeX;
+	int mapSizeY = params_.sizeY;
+	double heightScale = params_.heightScale;
+	double power = params_.power;
+	float step = step_;
+	// Grid points per 256 noise cells, the period of perlin(), or the
+	// requested period. Wrapping keeps coordinates positive and small
+	// enough for float precision.
+	const int period = params_.period > 0 ? params_.period : int(256 / noiseScale + 0.5);
+	auto wrap = [period](int i) { return (i % period + period) % period; };
+	const int cells[3] = { period_cells_, period_cells_, 256 };
+
+	#pragma omp parallel for schedule(dynamic, 8) num_threads(threads)
+	for(int i = 0; i < sizeX; ++i)
+	{
+		int x = x0 + i;
+		float* row = out + (size_t)i * sizeY;
+		float* slope = gradient ? gradient + 2 * (size_t)i * sizeY : nullptr;
+		std::vector<float> xs(sizeY), ys(sizeY), zs(sizeY);
+		for(int j = 0; j < sizeY; ++j)
+		{
+			xs[j] = wrap(x) * step;
+			ys[j] = wrap(y0 + j) * step;
+			zs[j] = z * step;
+		}
+		if(slope)
+		{
+			// The values are bit for bit the ones without a gradient.
+			std::vector<float> dx(sizeY), dy(sizeY), dz(sizeY);
+			if(period_cells_ && params_.octaves)
+				noise_.OctavePerlinPeriodicDerivBatch(xs.data(), ys.data(), zs.data(), row,
+						dx.data(), dy.data(), dz.data(), sizeY, octaves_, cells);
+			else if(period_cells_)
+				noise_.perlinPeriodicDerivBatch(xs.data(), ys.data(), zs.data(), row,
+						dx.data(), dy.data(), dz.data(), sizeY, cells);
+			else if(params_.octaves)
+				noise_.OctavePerlinDerivBatch(xs.data(), ys.data(), zs.data(), row,
+						dx.data(), dy.data(), dz.data(), sizeY, octaves_);
+			else
+				noise_.perlinDerivBatch(xs.data(), ys.data(), zs.data(), row,
+						dx.data(), dy.data(), dz.data(), sizeY);
+			// Noise slopes per grid step.
+			for(int j = 0; j < sizeY; ++j)
+			{
+				slope[2 * j] = dx[j] * step;
+				slope[2 * j + 1] = dy[j] * step;
+			}
+		}
+		else if(period_cells_ && params_.octaves)
+			noise_.OctavePerlinPeriodicBatch(xs.data(), ys.data(), zs.data(), row, sizeY, octaves_, cells);
+		else if(period_cells_)
+			noise_.perlinPeriodicBatch(xs.data(), ys.data(), zs.data(), row, sizeY, cells);
+		else if(params_.octaves)
+			noise_.OctavePerlinBatch(xs.data(), ys.data(), zs.data(), row, sizeY, octaves_);
+		else
+			noise_.perlinBatch(xs.data(), ys.data(), zs.data(), row, sizeY);
+
+		// Perlin noise
+		if(params_.type == 1)
+		{
+			for(int j = 0; j < sizeY; ++j)
+			{
+				double n = row[j];
+				row[j] = heightScale * n;
+			}
+			if(slope)
+				for(int j = 0; j < 2 * sizeY; ++j)
+					slope[j] *= heightScale;
+		}
+		else if(params_.type == 2)
+		{
+			double xPeriod = 5.0;
+			double yPeriod = 5.0;
+			for(int j = 0; j < sizeY; ++j)
+			{
+				int y = y0 + j;
+				double n = row[j];
+				double val = x * xPeriod / mapSizeX + y * yPeriod / mapSizeY + power * n;
+				row[j] = heightScale * fabs(sin(val * 3.14159));
+				if(slope)
+				{
+					// d|sin(a)| = sign(sin(a)) cos(a) da
+					double s = sin(val * 3.14159);
+					double dVal = heightScale * (s < 0 ? -1 : 1) * cos(val * 3.14159) * 3.14159;
+					slope[2 * j] = dVal * (xPeriod / mapSizeX + power * slope[2 * j]);
+					slope[2 * j + 1] = dVal * (yPeriod / mapSizeY + power * slope[2 * j + 1]);
+				}
+			}
+		}
+		else if(params_.type == 3)
+		{
+			double period = 5.0;
+			for(int j = 0; j < sizeY; ++j)
+			{
+				int y = y0 + j;
+				double n = row[j];
+				double xVal = (x - mapSizeX / 2) / (double)mapSizeX;
+				double yVal = (y - mapSizeY / 2) / (double)mapSizeY;
+				double radius = sqrt(xVal * xVal + yVal * yVal);
+				double dist = radius + power * n;
+				row[j] = heightScale * fabs(sin(2 * period * dist * 3.14159));
+				if(slope)
+				{
+					double a = 2 * period * dist * 3.14159;
+					double dDist = heightScale * (sin(a) < 0 ? -1 : 1) * cos(a) * 2 * period * 3.14159;
+					// The radius has no derivative at the centre; call
+					// it flat there.
+					double dRadiusX = radius > 0 ? xVal / (radius * mapSizeX) : 0.0;
+					double dRadiusY = radius > 0 ? yVal / (radius * mapSizeY) : 0.0;
+					slope[2 * j] = dDist * (dRadiusX + power * slope[2 * j]);
+					slope[2 * j + 1] = dDist * (dRadiusY + power * slope[2 * j + 1]);
+				}
+			}
+		}
+	}
+}
+
+TerrainGenerator::TerrainGenerator()
+{
+	worker_ = std::thread(&TerrainGenerator::run, this);
+}
+
+TerrainGenerator::~TerrainGenerator()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	wake_.notify_one();
+	worker_.join();
+}
+
+int TerrainGenerator::threadCount() const
+{
+#ifdef _OPENMP
+	if(threads_ > 0)
+		return threads_;
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+void TerrainGenerator::request(const HeightMapParams& params)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		requested_ = params;
+		pending_ = true;
+		++latest_;
+	}
+	wake_.notify_one();
+}
+
+void TerrainGenerator::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_.wait(lock, [this] { return finished_ == latest_; });
+}
+
+bool TerrainGenerator::swap()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if(!finished_map_)
+		return false;
+	front_ = std::move(finished_map_);
+	finished_map_.reset();
+	prefetch_map_.reset();
+	prefetch_slices_.clear();
+	return true;
+}
+
+void TerrainGenerator::prefetch(const std::vector<int>& slices)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		prefetch_map_ = front_;
+		prefetch_slices_ = slices;
+	}
+	wake_.notify_one();
+}
+
+void TerrainGenerator::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	for(;;)
+	{
+		wake_.wait(lock, [this] {
+			return quit_ || pending_ || !prefetch_slices_.empty();
+		});
+		if(quit_)
+			return;
+
+		if(pending_)
+		{
+			HeightMapParams params = requested_;
+			unsigned job = latest_;
+			pending_ = false;
+			lock.unlock();
+
+			std::shared_ptr<HeightMap> map = std::make_shared<HeightMap>(params, threadCount());
+			map->ensureSlice(0);
+
+			lock.lock();
+			// Drop the map if a newer request came in meanwhile.
+			if(job == latest_)
+			{
+				finished_map_ = map;
+				finished_ = job;
+				done_.notify_all();
+			}
+			continue;
+		}
+
+		// Prefetch one slice at a time so requests are never kept waiting
+		// behind a long prefetch.
+		std::shared_ptr<HeightMap> map = prefetch_map_;
+		int z = prefetch_slices_.front();
+		prefetch_slices_.erase(prefetch_slices_.begin());
+		lock.unlock();
+		if(map && z < map->params().sizeZ)
+			map->ensureSlice(z);
+		lock.lock();
+	}
+}
@@ -0,0 +1,189 @@
+#ifndef TERRAIN_GENERATOR_H
+#define TERRAIN_GENERATOR_H
+
+#include "height_volume.h"
+#include "perlin.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const double noiseScale = 0.05;
+// Grid quads along each edge of a culling chunk.
+const int chunkQuads = 32;
+
+/*
+ * HeightMapParams: everything generation reads, copied out of the GUI so
+ * that it can run off the render thread.
+ *      sizeX, sizeY, sizeZ: volume dimensions; generateTerrain reads one
+ *                           z slice per animation frame
+ *      storage: sample format of the volume
+ *      heightScale: scale applied to every map type
+ *      power: sinPow for type 2, ringPow for type 3, unused for type 1
+ *      seed: noise permutation, see PermutationTable::forSeed
+ *      period: grid points after which the noise repeats along x and y,
+ *              0 for none; see HeightField
+ */
+struct HeightMapParams {
+	int sizeX = 128;
+	int sizeY = 128;
+	int sizeZ = 128;
+	HeightVolume::Storage storage = HeightVolume::kFloat32;
+	int type = 1;
+	bool octaves = false;
+	int numOctaves = 1;
+	double persistence = 0.1;
+	double heightScale = 3.0;
+	double power = 0.0;
+	unsigned seed = 0;
+	int period = 0;
+};
+
+/*
+ * HeightField: the noise and map type transform behind a HeightMap, for
+ * any region of the grid. Grid point (x, y) of slice z samples the noise
+ * at (x, y, z) * noiseScale, so regions beyond [0, sizeX) x [0, sizeY)
+ * continue the map without a seam; sizeX and sizeY only set the period
+ * of map types 2 and 3. Grid points are wrapped by the noise's 256 cell
+ * period, since perlin() only handles positive coordinates.
+ *
+ * With a period, the noise is perlinPeriodic with the nearest whole
+ * number of cells per period, and the grid step is adjusted so that
+ * exactly that many cells span it. Map type 1 then repeats exactly, so
+ * one period can be generated once and tiled; types 2 and 3 add terms
+ * that do not repeat.
+ */
+class HeightField {
+public:
+	explicit HeightField(const HeightMapParams& params);
+
+	const HeightMapParams& params() const { return params_; }
+	float step() const { return step_; }
+	// Noise cells per period along x and y, 0 without a period.
+	int periodCells() const { return period_cells_; }
+	// Fills out with sizeX rows, for grid x0 to x0 + sizeX - 1, each
+	// sizeY heights long, for grid y0 onwards. If gradient is given it
+	// also receives the slope of every height along grid x and y, in
+	// height per grid step, as one (d/dx, d/dy) pair per height. Slopes
+	// come from the noise's analytic derivatives, so the same evaluation
+	// gives both.
+	// Safe to call from several threads at once.
+	void generate(int x0, int y0, int sizeX, int sizeY, int z, float* out, int threads,
+	              float* gradient = nullptr) const;
+private:
+	HeightMapParams params_;
+	PerlinF noise_;
+	PerlinF::OctaveTable octaves_;
+	// Noise coordinate step between grid points and, with a period, the
+	// noise cells along x and y it spans.
+	float step_;
+	int period_cells_ = 0;
+};
+
+/*
+ * HeightMap: a volume generated lazily one z slice at a time.
+ *
+ * Nothing is computed up front; a slice is generated the first time it is
+ * asked for. Any thread may ask: the first caller claims and fills it,
+ * concurrent callers wait for that to finish. Every map type yields
+ * heights in [0, heightScale], which is the range quantized storage
+ * spans.
+ */
+class HeightMap {
+public:
+	HeightMap(const HeightMapParams& params, int threads);
+
+	const HeightMapParams& params() const { return params_; }
+	bool hasSlice(int z) const { return state_[z] == kReady; }
+	// Generates slice z unless it already exists.
+	void ensureSlice(int z);
+	// Decodes slice z, generating it first if needed, into
+	// sizeX * sizeY floats (rows of x, each sizeY long).
+	void readSlice(int z, float* out);
+	// Slopes of slice z's heights along grid x and y, as
+	// HeightField::generate writes them, in readSlice order, generating
+	// the slice first if needed. They are kept with the heights, in float
+	// whatever the storage.
+	void readGradient(int z, float* out);
+	float at(int x, int y, int z);
+	const HeightVolume& volume() const { return volume_; }
+
+	// The grid is split into chunks of chunkQuads x chunkQuads quads;
+	// chunk (cx, cy) covers grid points cx * chunkQuads to
+	// (cx + 1) * chunkQuads along x, clamped to the map, and likewise y.
+	int chunksX() const { return (params_.sizeX - 2) / chunkQuads + 1; }
+	int chunksY() const { return (params_.sizeY - 2) / chunkQuads + 1; }
+	// Bounds of the stored heights of chunk (cx, cy) in slice z, recorded
+	// when the slice is generated. The slice must exist.
+	void chunkRange(int z, int cx, int cy, float& lo, float& hi) const;
+	// Bounds over grid points [x0, x1] x [y0, y1] of slice z, from the
+	// chunks overlapping them.
+	void range(int z, int x0, int y0, int x1, int y1, float& lo, float& hi) const;
+private:
+	enum { kEmpty, kBusy, kReady };
+
+	HeightMapParams params_;
+	int threads_;
+	HeightField field_;
+	HeightVolume volume_;
+	std::unique_ptr<std::atomic<int>[]> state_;
+	// Per slice, lo and hi of every chunk; filled before the slice is
+	// marked ready.
+	std::vector<std::vector<float>> chunk_ranges_;
+	// Per slice, the slopes readGradient returns; filled with the
+	// heights.
+	std::vector<std::vector<float>> slopes_;
+};
+
+/*
+ * TerrainGenerator: prepares height maps on a background thread.
+ *
+ * The render thread calls request() whenever parameters change and keeps
+ * drawing front() until swap() reports that a newer map is ready. A new
+ * request supersedes the one in flight, so only the latest parameters
+ * are ever published. Published maps have only slice 0 (the static view)
+ * generated; prefetch() asks the worker to fill the slices an animation
+ * is about to show.
+ */
+class TerrainGenerator {
+public:
+	TerrainGenerator();
+	~TerrainGenerator();
+
+	// Threads used per slice; 0 picks the OpenMP default (one per core).
+	void setThreads(int threads) { threads_ = threads; }
+	int threadCount() const;
+
+	void request(const HeightMapParams& params);
+	// Blocks until the latest request has been published.
+	void wait();
+	// Makes the newest published map the front one. Returns true if
+	// front() changed. Render thread only.
+	bool swap();
+	HeightMap& front() { return *front_; }
+	// Generates the given slices of front() in the background, replacing
+	// any earlier prefetch that has not run yet. Render thread only.
+	void prefetch(const std::vector<int>& slices);
+private:
+	void run();
+
+	std::thread worker_;
+	std::mutex mutex_;
+	std::condition_variable wake_, done_;
+	bool quit_ = false;
+	bool pending_ = false;
+	HeightMapParams requested_;
+	unsigned latest_ = 0, finished_ = 0;
+	int threads_ = 0;
+
+	// front_ is drawn; finished_map_ holds the last published map until
+	// the render thread swaps it in.
+	std::shared_ptr<HeightMap> front_, finished_map_;
+	std::shared_ptr<HeightMap> prefetch_map_;
+	std::vector<int> prefetch_slices_;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "terrain_lod.h"
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+
+TerrainLod::TerrainLod(float minX, float minZ, float extent, int mapSize)
+	: min_x_(minX), min_z_(minZ), extent_(extent), max_depth_(0)
+{
+	// Leaves stop at about one patch quad per texel.
+	while ((kLodPatchQuads << max_depth_) < mapSize - 1)
+		max_depth_++;
+	buildPatch(kLodPatchQuads + 1, true, patch_vertices_, patch_faces_);
+}
+
+void TerrainLod::select(const glm::vec3& eye, float minY, float maxY,
+		std::vector<LodNode>& nodes) const
+{
+	selectNode(eye, minY, maxY, min_x_, min_z_, extent_, 0, nodes);
+}
+
+void TerrainLod::selectNode(const glm::vec3& eye, float minY, float maxY,
+		float x, float z, float size, int depth,
+		std::vector<LodNode>& nodes) const
+{
+	glm::vec3 lo(x, minY, z);
+	glm::vec3 hi(x + size, maxY, z + size);
+	glm::vec3 nearest = glm::clamp(eye, lo, hi);
+	float distance = glm::length(eye - nearest);
+	if (depth < max_depth_ && distance < kLodRangeFactor * size) {
+		float half = size * 0.5f;
+		selectNode(eye, minY, maxY, x, z, half, depth + 1, nodes);
+		selectNode(eye, minY, maxY, x + half, z, half, depth + 1, nodes);
+		selectNode(eye, minY, maxY, x, z + half, half, depth + 1, nodes);
+		selectNode(eye, minY, maxY, x + half, z + half, half, depth + 1, nodes);
+		return;
+	}
+	nodes.push_back({ x, z, size, depth });
+}
+
+void TerrainLod::buildPatch(int n, bool skirts,
+		std::vector<glm::vec4>& vertices,
+		std::vector<glm::uvec3>& faces)
+{
+	vertices.resize(n * n);
+	for (int a = 0; a < n; a++)
+		for (int b = 0; b < n; b++)
+			vertices[a * n + b] = glm::vec4(a / float(n - 1), b / float(n - 1), 0.0f, 1.0f);
+
+	// Same triangulation and winding as generateTerrainIndices.
+	faces.clear();
+	faces.reserve(2 * (n - 1) * (n - 1) + (skirts ? 16 * (n - 1) : 0));
+	for (int x = 0; x < n - 1; x++) {
+		for (int z = 0; z < n - 1; z++) {
+			int v1 = x + z * n;
+			int v2 = x + z * n + 1;
+			int v3 = x + (z + 1) * n;
+			int v4 = x + (z + 1) * n + 1;
+			faces.push_back(glm::uvec3(v1, v2, v3));
+			faces.push_back(glm::uvec3(v4, v3, v2));
+		}
+	}
+	if (!skirts)
+		return;
+
+	// Each border edge gets its own pair of lowered vertices.
+	int sides[4][2] = {
+		// first vertex, step along the side
+		{ 0, 1 },              // a = 0
+		{ (n - 1) * n, 1 },    // a = n - 1
+		{ 0, n },              // b = 0
+		{ n - 1, n },          // b = n - 1
+	};
+	for (auto& side : sides) {
+		for (int i = 0; i < n - 1; i++) {
+			unsigned p = side[0] + i * side[1];
+			unsigned q = p + side[1];
+			unsigned ps = vertices.size();
+			vertices.push_back(vertices[p] + glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+			vertices.push_back(vertices[q] + glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+			unsigned qs = ps + 1;
+			faces.push_back(glm::uvec3(p, q, ps));
+			faces.push_back(glm::uvec3(q, qs, ps));
+			faces.push_back(glm::uvec3(p, ps, q));
+			faces.push_back(glm::uvec3(q, ps, qs));
+		}
+	}
+}
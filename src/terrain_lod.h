@@ -0,0 +1,65 @@
+#ifndef TERRAIN_LOD_H
+#define TERRAIN_LOD_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+ * LodNode: one square terrain patch picked by TerrainLod::select.
+ *      x, z: world position of the patch's low corner
+ *      size: edge length in world units
+ *      depth: quadtree depth, 0 is the whole terrain
+ */
+struct LodNode {
+	float x, z, size;
+	int depth;
+};
+
+/*
+ * TerrainLod: quadtree level of detail over a square heightfield.
+ *
+ * Every node is drawn with the same patch mesh of kLodPatchQuads^2 quads,
+ * placed and scaled by terrain.vert, so the triangle count depends on the
+ * number of selected nodes rather than the map size. A node is split
+ * while the camera is closer than kLodRangeFactor times its size, down to
+ * the depth where patch quads match the heightfield's texels.
+ *
+ * Neighbouring nodes of different depth do not share all edge vertices;
+ * the patch carries a skirt along its border that terrain.vert lowers to
+ * hide the resulting cracks.
+ */
+class TerrainLod {
+public:
+	TerrainLod(float minX, float minZ, float extent, int mapSize);
+
+	int maxDepth() const { return max_depth_; }
+	// Appends the nodes to draw for a camera at eye. minY and maxY bound
+	// the terrain heights, for the distance to each node's box.
+	void select(const glm::vec3& eye, float minY, float maxY,
+	            std::vector<LodNode>& nodes) const;
+
+	const std::vector<glm::vec4>& patchVertices() const { return patch_vertices_; }
+	const std::vector<glm::uvec3>& patchFaces() const { return patch_faces_; }
+
+	/*
+	 * buildPatch: an n x n grid of vertices with the xy of each in
+	 * [0, 1]^2 and w = 1. Vertex (a, b) is at (a, b) / (n - 1) with index
+	 * a * n + b, the layout generateTerrain uses. With skirts, border
+	 * vertices are repeated with z = 1 and joined to the border by
+	 * triangles of both windings, after the surface triangles.
+	 */
+	static void buildPatch(int n, bool skirts,
+	                       std::vector<glm::vec4>& vertices,
+	                       std::vector<glm::uvec3>& faces);
+private:
+	void selectNode(const glm::vec3& eye, float minY, float maxY,
+	                float x, float z, float size, int depth,
+	                std::vector<LodNode>& nodes) const;
+
+	float min_x_, min_z_, extent_;
+	int max_depth_;
+	std::vector<glm::vec4> patch_vertices_;
+	std::vector<glm::uvec3> patch_faces_;
+};
+
+#endif
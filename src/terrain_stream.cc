@@ -0,0 +1,218 @@
+#include "terrain_stream.h"
+
+#include <algorithm>
+#include <cmath>
+
+TerrainStream::TerrainStream(double originX, double originZ, double spacing, int threads)
+	: origin_x_(originX), origin_z_(originZ), spacing_(spacing)
+{
+	size_t tileBytes = tileVertices() * 3 * sizeof(glm::vec4);
+	int needed = (2 * kStreamRadius + 1) * (2 * kStreamRadius + 1);
+	slots_ = std::max(needed, int(((size_t)kStreamBudgetMB << 20) / tileBytes));
+	for(int slot = slots_ - 1; slot >= 0; --slot)
+		free_slots_.push_back(slot);
+	for(int i = 0; i < std::max(threads, 1); ++i)
+		workers_.emplace_back(&TerrainStream::run, this);
+}
+
+TerrainStream::~TerrainStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	wake_.notify_all();
+	for(std::thread& worker : workers_)
+		worker.join();
+}
+
+void TerrainStream::setParams(const HeightMapParams& params, int z)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		field_ = std::make_shared<HeightField>(params);
+		slice_ = z;
+		++epoch_;
+		queue_.clear();
+		building_.clear();
+		finished_.clear();
+	}
+	period_tiles_ = 0;
+	if(params.type == 1 && params.period > 0 && params.period % kStreamTileQuads == 0)
+		period_tiles_ = params.period / kStreamTileQuads;
+	lru_.clear();
+	resident_.clear();
+	shown_.clear();
+	free_slots_.clear();
+	for(int slot = slots_ - 1; slot >= 0; --slot)
+		free_slots_.push_back(slot);
+}
+
+std::pair<int, int> TerrainStream::source(int x, int z) const
+{
+	if(!period_tiles_)
+		return std::make_pair(x, z);
+	return std::make_pair((x % period_tiles_ + period_tiles_) % period_tiles_,
+	                      (z % period_tiles_ + period_tiles_) % period_tiles_);
+}
+
+void TerrainStream::update(const glm::vec3& eye, int maxUploads,
+		const std::function<void(int, const StreamMesh&)>& upload)
+{
+	double tileSize = kStreamTileQuads * spacing_;
+	int eyeX = (int)std::floor((eye.x - origin_x_) / tileSize);
+	int eyeZ = (int)std::floor((eye.z - origin_z_) / tileSize);
+
+	// Nearest first, so the workers fill in the view from the camera out.
+	std::vector<std::pair<int, int>> around;
+	for(int x = eyeX - kStreamRadius; x <= eyeX + kStreamRadius; ++x)
+		for(int z = eyeZ - kStreamRadius; z <= eyeZ + kStreamRadius; ++z)
+			around.emplace_back(x, z);
+	std::sort(around.begin(), around.end(),
+	          [eyeX, eyeZ](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+		int da = (a.first - eyeX) * (a.first - eyeX) + (a.second - eyeZ) * (a.second - eyeZ);
+		int db = (b.first - eyeX) * (b.first - eyeX) + (b.second - eyeZ) * (b.second - eyeZ);
+		return da < db;
+	});
+	std::set<Key> wanted;
+	for(const std::pair<int, int>& tile : around)
+	{
+		std::pair<int, int> from = source(tile.first, tile.second);
+		Key k = key(from.first, from.second);
+		wanted.insert(k);
+		auto it = resident_.find(k);
+		if(it != resident_.end())
+			lru_.splice(lru_.begin(), lru_, it->second);
+	}
+
+	std::vector<Finished> finished;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		finished.swap(finished_);
+	}
+	// Tiles the camera has left since they were queued are dropped
+	// rather than evicting ones it may return to.
+	size_t done = 0;
+	for(; done < finished.size() && maxUploads > 0; ++done)
+	{
+		Finished& tile = finished[done];
+		Key k = key(tile.x, tile.z);
+		if(!wanted.count(k) || resident_.count(k))
+			continue;
+		int slot;
+		if(!free_slots_.empty())
+		{
+			slot = free_slots_.back();
+			free_slots_.pop_back();
+		}
+		else
+		{
+			// Wanted tiles are at the front and the pool has room for
+			// all of them, so the back one is not wanted now.
+			StreamTile evicted = lru_.back();
+			resident_.erase(key(evicted.x, evicted.z));
+			lru_.pop_back();
+			slot = evicted.slot;
+		}
+		upload(slot, *tile.mesh);
+		lru_.push_front({ tile.x, tile.z, slot, tile.mesh->lo, tile.mesh->hi });
+		resident_[k] = lru_.begin();
+		--maxUploads;
+	}
+
+	shown_.clear();
+	std::deque<std::pair<int, int>> missing;
+	std::set<Key> queued;
+	std::lock_guard<std::mutex> lock(mutex_);
+	for(size_t i = done; i < finished.size(); ++i)
+		finished_.push_back(std::move(finished[i]));
+	for(size_t i = 0; i < done; ++i)
+		building_.erase(key(finished[i].x, finished[i].z));
+	for(const std::pair<int, int>& tile : around)
+	{
+		std::pair<int, int> from = source(tile.first, tile.second);
+		Key k = key(from.first, from.second);
+		auto it = resident_.find(k);
+		if(it != resident_.end())
+		{
+			StreamTile shown = *it->second;
+			shown.x = tile.first;
+			shown.z = tile.second;
+			shown_.push_back(shown);
+		}
+		else if(!building_.count(k) && queued.insert(k).second)
+		{
+			missing.push_back(from);
+		}
+	}
+	queue_.swap(missing);
+	if(!queue_.empty())
+		wake_.notify_all();
+}
+
+void TerrainStream::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	for(;;)
+	{
+		wake_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+		if(quit_)
+			return;
+
+		std::pair<int, int> tile = queue_.front();
+		queue_.pop_front();
+		building_.insert(key(tile.first, tile.second));
+		std::shared_ptr<HeightField> field = field_;
+		int z = slice_;
+		unsigned epoch = epoch_;
+		lock.unlock();
+
+		std::unique_ptr<StreamMesh> mesh(new StreamMesh);
+		buildMesh(*field, z, tile.first, tile.second, *mesh);
+
+		lock.lock();
+		if(epoch == epoch_)
+			finished_.push_back({ tile.first, tile.second, std::move(mesh) });
+	}
+}
+
+// Normals come from the field's analytic slopes, which are the same at a
+// grid point whichever tile evaluates it, so tile edges match.
+void TerrainStream::buildMesh(const HeightField& field, int z, int tileX, int tileZ,
+		StreamMesh& mesh) const
+{
+	const int n = kStreamTileQuads + 1;
+	int gridX = tileX * kStreamTileQuads;
+	int gridZ = tileZ * kStreamTileQuads;
+	double heightScale = field.params().heightScale;
+	std::vector<float> heights(n * n), slopes(2 * n * n);
+	field.generate(gridX, gridZ, n, n, z, heights.data(), 1, slopes.data());
+
+	mesh.vertices.resize(n * n);
+	mesh.normals.resize(n * n);
+	mesh.colors.resize(n * n);
+	mesh.lo = mesh.hi = heights[0];
+	for(int a = 0; a < n; ++a)
+	{
+		for(int b = 0; b < n; ++b)
+		{
+			int i = a * n + b;
+			double posX = a * spacing_;
+			double posZ = b * spacing_;
+			double posY = heights[i];
+			mesh.lo = std::min(mesh.lo, (float)posY);
+			mesh.hi = std::max(mesh.hi, (float)posY);
+
+			mesh.vertices[i] = glm::vec4(posX, posY, posZ, 1.0);
+			double dY_dX = slopes[2 * i] / spacing_;
+			double dY_dZ = slopes[2 * i + 1] / spacing_;
+			mesh.normals[i] = glm::vec4(glm::normalize(glm::vec3(-dY_dX, 1.0, -dY_dZ)), 0.0);
+			if(posY >= 0.7 * heightScale)
+				mesh.colors[i] = glm::vec4(1.0, 1.0, 1.0, 1.0);
+			else if(posY >= 0.45 * heightScale)
+				mesh.colors[i] = glm::vec4(0.2, 0.1, 0.0, 1.0);
+			else
+				mesh.colors[i] = glm::vec4(0.0, 1.0, 0.0, 1.0);
+		}
+	}
+}
@@ -0,0 +1,122 @@
+#ifndef TERRAIN_STREAM_H
+#define TERRAIN_STREAM_H
+
+#include "config.h"
+#include "terrain_generator.h"
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * StreamMesh: the vertices of one streamed tile, (kStreamTileQuads + 1)^2
+ * of each in TerrainLod::buildPatch order, so every tile shares one
+ * index buffer. Positions are relative to the tile's low corner; the
+ * model matrix places it.
+ */
+struct StreamMesh {
+	std::vector<glm::vec4> vertices, normals, colors;
+	float lo, hi; // bounds of the heights
+};
+
+/*
+ * StreamTile: a resident tile.
+ *      x, z: tile coordinates; the tile covers grid points x * kStreamTileQuads
+ *            to (x + 1) * kStreamTileQuads, and likewise along z
+ *      slot: where its vertices sit in the mesh pool, shared by every tile
+ *            with the same heights
+ *      lo, hi: bounds of its heights
+ */
+struct StreamTile {
+	int x, z;
+	int slot;
+	float lo, hi;
+};
+
+/*
+ * TerrainStream: terrain without edges, generated in tiles around the
+ * camera.
+ *
+ * Worker threads build tile meshes from a HeightField, nearest to the
+ * camera first. Finished meshes are handed to the render thread, which
+ * copies them into fixed slots of a mesh pool sized by kStreamBudgetMB.
+ * Tiles that leave the camera's neighbourhood stay in their slot until
+ * the pool is full, then the least recently wanted one is evicted, so
+ * turning back is free and memory never grows past the budget.
+ *
+ * When the field repeats (map type 1 with a period that is a whole
+ * number of tiles) tiles a period apart are the same mesh. It is built
+ * and stored once and drawn at every position, so a period's worth of
+ * tiles covers any distance.
+ */
+class TerrainStream {
+public:
+	// Grid point (0, 0) sits at (originX, originZ), neighbours spacing
+	// apart. threads: number of worker threads.
+	TerrainStream(double originX, double originZ, double spacing, int threads);
+	~TerrainStream();
+
+	static int tileVertices() { return (kStreamTileQuads + 1) * (kStreamTileQuads + 1); }
+	int slots() const { return slots_; }
+	// Drops every tile and streams slice z of a field with these
+	// parameters instead. Render thread only.
+	void setParams(const HeightMapParams& params, int z);
+	/*
+	 * update: makes the tiles within kStreamRadius tiles of eye current.
+	 * Up to maxUploads finished tiles are given a slot and passed to
+	 * upload(slot, mesh), which must copy the mesh into the pool; missing
+	 * tiles are queued for the workers. Render thread only.
+	 */
+	void update(const glm::vec3& eye, int maxUploads,
+	            const std::function<void(int, const StreamMesh&)>& upload);
+	// Tiles around the camera whose mesh is resident, as of the last
+	// update().
+	const std::vector<StreamTile>& tiles() const { return shown_; }
+private:
+	typedef int64_t Key;
+	static Key key(int x, int z) { return (int64_t)x << 32 | (uint32_t)z; }
+	struct Finished {
+		int x, z;
+		std::unique_ptr<StreamMesh> mesh;
+	};
+	void run();
+	void buildMesh(const HeightField& field, int z, int tileX, int tileZ, StreamMesh& mesh) const;
+	// The tile whose mesh tile (x, z) reuses.
+	std::pair<int, int> source(int x, int z) const;
+
+	double origin_x_, origin_z_, spacing_;
+	int slots_;
+	int period_tiles_ = 0; // tiles per period of the field, 0 if it does not repeat
+
+	// Render thread: resident meshes by source tile, most recently wanted
+	// first.
+	std::list<StreamTile> lru_;
+	std::unordered_map<Key, std::list<StreamTile>::iterator> resident_;
+	std::vector<int> free_slots_;
+	std::vector<StreamTile> shown_;
+
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool quit_ = false;
+	// Guarded by mutex_. epoch_ counts setParams() calls, so tiles of
+	// older parameters are dropped when they finish.
+	std::shared_ptr<HeightField> field_;
+	int slice_ = 0;
+	unsigned epoch_ = 0;
+	std::deque<std::pair<int, int>> queue_;
+	// Tiles taken by a worker and not yet installed or dropped.
+	std::set<Key> building_;
+	std::vector<Finished> finished_;
+};
+
+#endif
@@ -0,0 +1,412 @@
+// Checks the Perlin noise variants against the scalar double reference.
+// Run by ctest; exits non-zero if any check fails.
+
+#include "perlin.h"
+#include "perlin_simd.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// Grid spacing of the samples main.cc draws, see terrain_generator.h.
+const double noiseScale = 0.05;
+
+int failures = 0;
+
+void report(const char* name, double maxError, double bound)
+{
+    bool ok = maxError <= bound;
+    failures += !ok;
+    std::cout << name << ": max error " << maxError << " (bound " << bound << ")"
+              << (ok ? "" : "  FAILED") << "\n";
+}
+
+// PerlinF against Perlin over the 128^3 grid main.cc samples and random
+// points in [0, 256); perlin.h documents the bound.
+void testFloatMatchesDouble()
+{
+    const double bound = 1e-6;
+    Perlin reference;
+    PerlinF single;
+
+    double maxError = 0.0;
+    for(int x = 0; x < 128; ++x)
+    {
+        for(int y = 0; y < 128; ++y)
+        {
+            for(int z = 0; z < 128; ++z)
+            {
+                // HeightField scales in float, as here.
+                double d = reference.perlin(x * noiseScale, y * noiseScale, z * noiseScale);
+                float f = single.perlin(x * float(noiseScale), y * float(noiseScale),
+                                        z * float(noiseScale));
+                maxError = std::max(maxError, std::fabs(d - f));
+            }
+        }
+    }
+    report("PerlinF vs Perlin, 128^3 grid", maxError, bound);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(0.0f, 256.0f);
+    maxError = 0.0;
+    for(int i = 0; i < 1000000; ++i)
+    {
+        // Both see the same float coordinates, so only the evaluation
+        // differs.
+        float x = coord(rng), y = coord(rng), z = coord(rng);
+        maxError = std::max(maxError, std::fabs(reference.perlin(x, y, z) - single.perlin(x, y, z)));
+    }
+    report("PerlinF vs Perlin, random points", maxError, bound);
+}
+
+// Analytic gradients against central differences at random points, for
+// each derivative variant. Values must equal the plain functions' bit for
+// bit.
+void testDerivMatchesDifferences()
+{
+    const double h = 1e-5;
+    const double bound = 1e-6;
+    const int period[3] = { 24, 80, 256 };
+    Perlin noise(3);
+    Perlin::OctaveTable table(5, 0.5);
+
+    // Each returns a value and fills a gradient; plain is what the value
+    // must equal.
+    struct Variant
+    {
+        const char* name;
+        std::function<double(double, double, double, double*)> deriv;
+        std::function<double(double, double, double)> plain;
+    };
+    Variant variants[] = {
+        { "perlinDeriv",
+          [&](double x, double y, double z, double* g) { return noise.perlinDeriv(x, y, z, g); },
+          [&](double x, double y, double z) { return noise.perlin(x, y, z); } },
+        { "OctavePerlinDeriv",
+          [&](double x, double y, double z, double* g) { return noise.OctavePerlinDeriv(x, y, z, table, g); },
+          [&](double x, double y, double z) { return noise.OctavePerlin(x, y, z, table); } },
+        { "perlinPeriodicDeriv",
+          [&](double x, double y, double z, double* g) { return noise.perlinPeriodicDeriv(x, y, z, period, g); },
+          [&](double x, double y, double z) { return noise.perlinPeriodic(x, y, z, period); } },
+        { "OctavePerlinPeriodicDeriv",
+          [&](double x, double y, double z, double* g) {
+              return noise.OctavePerlinPeriodicDeriv(x, y, z, table, period, g);
+          },
+          [&](double x, double y, double z) { return noise.OctavePerlinPeriodic(x, y, z, table, period); } },
+    };
+
+    std::mt19937 rng(2);
+    // Kept clear of 0 so that x - h stays positive, as perlin() requires,
+    // and wide enough to cross the periods.
+    std::uniform_real_distribution<double> coord(1.0, 100.0);
+    for(const Variant& variant : variants)
+    {
+        double maxError = 0.0;
+        int valueMismatches = 0;
+        for(int i = 0; i < 100000; ++i)
+        {
+            double c[3] = { coord(rng), coord(rng), coord(rng) };
+            double g[3];
+            double value = variant.deriv(c[0], c[1], c[2], g);
+            valueMismatches += value != variant.plain(c[0], c[1], c[2]);
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                double lo[3] = { c[0], c[1], c[2] }, hi[3] = { c[0], c[1], c[2] };
+                lo[axis] -= h;
+                hi[axis] += h;
+                double diff = (variant.plain(hi[0], hi[1], hi[2]) -
+                               variant.plain(lo[0], lo[1], lo[2])) / (2 * h);
+                maxError = std::max(maxError, std::fabs(g[axis] - diff));
+            }
+        }
+        report(variant.name, maxError, bound);
+        failures += valueMismatches != 0;
+        if(valueMismatches)
+            std::cout << variant.name << ": " << valueMismatches << " values differ  FAILED\n";
+    }
+}
+
+// perlinBatch and OctavePerlinBatch must match perlin() and OctavePerlin
+// bit for bit. Every kernel the CPU supports is run on its own, not only
+// the widest, and the public functions cover the scalar tail.
+template <typename Real>
+void testBatchIsExact(const char* name)
+{
+    BasicPerlin<Real> noise(5);
+    typename BasicPerlin<Real>::OctaveTable table(5, Real(0.5));
+
+    // An odd count leaves a tail for the scalar code.
+    const size_t n = 1001;
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<Real> coord(0, 300);
+    std::vector<Real> xs(n), ys(n), zs(n), out(n), octaveOut(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        xs[i] = coord(rng);
+        ys[i] = coord(rng);
+        zs[i] = coord(rng);
+    }
+    auto mismatches = [&]() -> int {
+        int count = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            count += out[i] != noise.perlin(xs[i], ys[i], zs[i]);
+            count += octaveOut[i] != noise.OctavePerlin(xs[i], ys[i], zs[i], table);
+        }
+        return count;
+    };
+
+    const PerlinIsa isas[] = { kPerlinSse2, kPerlinAvx2 };
+    const char* isaNames[] = { "SSE2", "AVX2" };
+    for(int k = 0; k < 2; ++k)
+    {
+        PerlinKernels<Real> kernels = perlinKernelsFor<Real>(isas[k]);
+        if(!kernels.batch)
+        {
+            std::cout << name << " " << isaNames[k] << " batch: not supported, skipped\n";
+            continue;
+        }
+        size_t done = kernels.batch(noise.permutationTable(), xs.data(), ys.data(), zs.data(),
+                                    out.data(), n, nullptr);
+        size_t octaveDone = kernels.octaves(noise.permutationTable(), xs.data(), ys.data(), zs.data(),
+                                            octaveOut.data(), n, table.frequency.data(),
+                                            table.amplitude.data(), table.octaves(), table.maxVal,
+                                            nullptr);
+        for(size_t i = done; i < n; ++i)
+            out[i] = noise.perlin(xs[i], ys[i], zs[i]);
+        for(size_t i = octaveDone; i < n; ++i)
+            octaveOut[i] = noise.OctavePerlin(xs[i], ys[i], zs[i], table);
+        int count = mismatches();
+        failures += count != 0;
+        std::cout << name << " " << isaNames[k] << " batch: " << count << " samples differ"
+                  << (count ? "  FAILED" : "") << "\n";
+    }
+
+    noise.perlinBatch(xs.data(), ys.data(), zs.data(), out.data(), n);
+    noise.OctavePerlinBatch(xs.data(), ys.data(), zs.data(), octaveOut.data(), n, table);
+    int count = mismatches();
+    failures += count != 0;
+    std::cout << name << " perlinBatch and OctavePerlinBatch: " << count << " samples differ"
+              << (count ? "  FAILED" : "") << "\n";
+}
+
+// The derivative batch functions must match perlinDeriv and its
+// variants bit for bit, values and gradients, on every kernel the CPU
+// supports and through the public functions.
+template <typename Real>
+void testDerivBatchIsExact(const char* name)
+{
+    const int period[3] = { 24, 80, 5 };
+    BasicPerlin<Real> noise(7);
+    typename BasicPerlin<Real>::OctaveTable table(5, Real(0.5));
+
+    // An odd count leaves a tail for the scalar code.
+    const size_t n = 1001;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<Real> coord(0, 300);
+    std::vector<Real> xs(n), ys(n), zs(n), out(n), dx(n), dy(n), dz(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        xs[i] = coord(rng);
+        ys[i] = coord(rng);
+        zs[i] = coord(rng);
+    }
+    // variant: 0 perlinDeriv, 1 OctavePerlinDeriv, each periodic if
+    // periodic is set.
+    auto scalar = [&](int variant, bool periodic, size_t i, Real* g) -> Real {
+        if(variant == 0)
+            return periodic ? noise.perlinPeriodicDeriv(xs[i], ys[i], zs[i], period, g)
+                            : noise.perlinDeriv(xs[i], ys[i], zs[i], g);
+        return periodic ? noise.OctavePerlinPeriodicDeriv(xs[i], ys[i], zs[i], table, period, g)
+                        : noise.OctavePerlinDeriv(xs[i], ys[i], zs[i], table, g);
+    };
+    // Fills the samples from done onwards with the scalar code, as the
+    // public functions do, then counts those that differ.
+    auto mismatches = [&](int variant, bool periodic, size_t done) -> int {
+        int count = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            Real g[3];
+            Real value = scalar(variant, periodic, i, g);
+            if(i >= done)
+            {
+                out[i] = value;
+                dx[i] = g[0];
+                dy[i] = g[1];
+                dz[i] = g[2];
+            }
+            count += out[i] != value || dx[i] != g[0] || dy[i] != g[1] || dz[i] != g[2];
+        }
+        return count;
+    };
+
+    const PerlinIsa isas[] = { kPerlinSse2, kPerlinAvx2 };
+    const char* isaNames[] = { "SSE2", "AVX2" };
+    for(int k = 0; k < 2; ++k)
+    {
+        PerlinKernels<Real> kernels = perlinKernelsFor<Real>(isas[k]);
+        if(!kernels.deriv)
+        {
+            std::cout << name << " " << isaNames[k] << " deriv batch: not supported, skipped\n";
+            continue;
+        }
+        int count = 0;
+        for(int periodic = 0; periodic < 2; ++periodic)
+        {
+            const int* kernelPeriod = periodic ? period : nullptr;
+            size_t done = kernels.deriv(noise.permutationTable(), xs.data(), ys.data(), zs.data(),
+                                        out.data(), dx.data(), dy.data(), dz.data(), n, kernelPeriod);
+            count += mismatches(0, periodic, done);
+            done = kernels.octaveDeriv(noise.permutationTable(), xs.data(), ys.data(), zs.data(),
+                                       out.data(), dx.data(), dy.data(), dz.data(), n,
+                                       table.frequency.data(), table.amplitude.data(),
+                                       table.octaves(), table.maxVal, kernelPeriod);
+            count += mismatches(1, periodic, done);
+        }
+        failures += count != 0;
+        std::cout << name << " " << isaNames[k] << " deriv batch: " << count << " samples differ"
+                  << (count ? "  FAILED" : "") << "\n";
+    }
+
+    int count = 0;
+    noise.perlinDerivBatch(xs.data(), ys.data(), zs.data(), out.data(), dx.data(), dy.data(), dz.data(), n);
+    count += mismatches(0, false, n);
+    noise.perlinPeriodicDerivBatch(xs.data(), ys.data(), zs.data(), out.data(),
+                                   dx.data(), dy.data(), dz.data(), n, period);
+    count += mismatches(0, true, n);
+    noise.OctavePerlinDerivBatch(xs.data(), ys.data(), zs.data(), out.data(),
+                                 dx.data(), dy.data(), dz.data(), n, table);
+    count += mismatches(1, false, n);
+    noise.OctavePerlinPeriodicDerivBatch(xs.data(), ys.data(), zs.data(), out.data(),
+                                         dx.data(), dy.data(), dz.data(), n, table, period);
+    count += mismatches(1, true, n);
+    failures += count != 0;
+    std::cout << name << " derivative batch functions: " << count << " samples differ"
+              << (count ? "  FAILED" : "") << "\n";
+}
+
+// Periodic noise: at a period of 256 it is the plain noise bit for bit,
+// it repeats exactly, and the batch kernels match the scalar functions
+// bit for bit.
+template <typename Real>
+void testPeriodic(const char* name)
+{
+    const int full[3] = { 256, 256, 256 };
+    const int period[3] = { 24, 80, 5 };
+    BasicPerlin<Real> noise(11);
+    typename BasicPerlin<Real>::OctaveTable table(5, Real(0.5));
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<Real> coord(0, 256);
+    int plainMismatches = 0;
+    for(int i = 0; i < 100000; ++i)
+    {
+        Real x = coord(rng), y = coord(rng), z = coord(rng);
+        plainMismatches += noise.perlinPeriodic(x, y, z, full) != noise.perlin(x, y, z);
+        plainMismatches += noise.OctavePerlinPeriodic(x, y, z, table, full) !=
+                           noise.OctavePerlin(x, y, z, table);
+    }
+
+    // Multiples of 1/8 keep their cell offsets exact a period away.
+    int repeatMismatches = 0;
+    for(int i = 0; i < 2000; ++i)
+    {
+        Real x = Real(i % 200) / 8, y = Real(i % 77) / 8 + 3, z = Real(i % 13) / 8 + 1;
+        Real base = noise.OctavePerlinPeriodic(x, y, z, table, period);
+        repeatMismatches += noise.OctavePerlinPeriodic(x + period[0], y, z, table, period) != base;
+        repeatMismatches += noise.OctavePerlinPeriodic(x, y + period[1], z, table, period) != base;
+        repeatMismatches += noise.OctavePerlinPeriodic(x, y, z + 2 * period[2], table, period) != base;
+    }
+
+    // An odd count leaves a tail for the scalar code.
+    const size_t n = 1001;
+    std::uniform_real_distribution<Real> wide(0, 300);
+    std::vector<Real> xs(n), ys(n), zs(n), out(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        xs[i] = wide(rng);
+        ys[i] = wide(rng);
+        zs[i] = wide(rng);
+    }
+    int batchMismatches = 0;
+    noise.perlinPeriodicBatch(xs.data(), ys.data(), zs.data(), out.data(), n, period);
+    for(size_t i = 0; i < n; ++i)
+        batchMismatches += out[i] != noise.perlinPeriodic(xs[i], ys[i], zs[i], period);
+    noise.OctavePerlinPeriodicBatch(xs.data(), ys.data(), zs.data(), out.data(), n, table, period);
+    for(size_t i = 0; i < n; ++i)
+        batchMismatches += out[i] != noise.OctavePerlinPeriodic(xs[i], ys[i], zs[i], table, period);
+
+    int mismatches = plainMismatches + repeatMismatches + batchMismatches;
+    failures += mismatches != 0;
+    std::cout << name << " periodic: " << plainMismatches << " differ from plain at period 256, "
+              << repeatMismatches << " do not repeat, " << batchMismatches << " batch samples differ"
+              << (mismatches ? "  FAILED" : "") << "\n";
+}
+
+
+// Octave counts past maxPerlinOctaves are capped, and periods scaled by
+// the top octaves' frequencies saturate rather than overflow int, with
+// the batch kernels still matching the scalar code.
+template <typename Real>
+void testManyOctaves(const char* name)
+{
+    const int period[3] = { 100000, 70000, 256 };
+    BasicPerlin<Real> noise(13);
+    typename BasicPerlin<Real>::OctaveTable table(40, Real(0.5));
+
+    const size_t n = 1001;
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<Real> coord(0, 100);
+    std::vector<Real> xs(n), ys(n), zs(n), out(n), dx(n), dy(n), dz(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        xs[i] = coord(rng);
+        ys[i] = coord(rng);
+        zs[i] = coord(rng);
+    }
+    int mismatches = 0;
+    noise.OctavePerlinPeriodicBatch(xs.data(), ys.data(), zs.data(), out.data(), n, table, period);
+    for(size_t i = 0; i < n; ++i)
+        mismatches += out[i] != noise.OctavePerlinPeriodic(xs[i], ys[i], zs[i], table, period);
+    noise.OctavePerlinPeriodicDerivBatch(xs.data(), ys.data(), zs.data(), out.data(),
+                                         dx.data(), dy.data(), dz.data(), n, table, period);
+    for(size_t i = 0; i < n; ++i)
+    {
+        Real g[3];
+        Real value = noise.OctavePerlinPeriodicDeriv(xs[i], ys[i], zs[i], table, period, g);
+        mismatches += out[i] != value || dx[i] != g[0] || dy[i] != g[1] || dz[i] != g[2];
+    }
+
+    bool capped = table.octaves() == maxPerlinOctaves;
+    bool saturated = octavePeriod(period[0], table.frequency.back()) == INT_MAX;
+    bool ok = capped && saturated && mismatches == 0;
+    failures += !ok;
+    std::cout << name << " " << table.octaves() << " of 40 octaves: period "
+              << (saturated ? "saturated" : "not saturated") << ", " << mismatches
+              << " batch samples differ" << (ok ? "" : "  FAILED") << "\n";
+}
+}
+
+int main()
+{
+    testFloatMatchesDouble();
+    testBatchIsExact<double>("Perlin");
+    testBatchIsExact<float>("PerlinF");
+    testDerivMatchesDifferences();
+    testDerivBatchIsExact<double>("Perlin");
+    testDerivBatchIsExact<float>("PerlinF");
+    testPeriodic<double>("Perlin");
+    testPeriodic<float>("PerlinF");
+    testManyOctaves<double>("Perlin");
+    testManyOctaves<float>("PerlinF");
+    std::cout << (failures ? "FAILED" : "all checks passed") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include <GL/glew.h>
+#include "uniform_block.h"
+#include <cstring>
+#include <iostream>
+#include <debuggl.h>
+
+UniformBlock::UniformBlock(const std::string& name, size_t bytes)
+	: name_(name), shadow_(bytes)
+{
+	if (bindings_.count(name))
+		throw __func__+std::string(": error, uniform block ")+name+" already exists";
+	binding_ = next_binding_++;
+	bindings_[name] = binding_;
+	CHECK_GL_ERROR(glGenBuffers(1, &buffer_));
+	CHECK_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, buffer_));
+	CHECK_GL_ERROR(glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW));
+	CHECK_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+	CHECK_GL_ERROR(glBindBufferBase(GL_UNIFORM_BUFFER, binding_, buffer_));
+}
+
+UniformBlock::~UniformBlock()
+{
+	bindings_.erase(name_);
+	CHECK_GL_ERROR(glDeleteBuffers(1, &buffer_));
+}
+
+void UniformBlock::update(const void* data)
+{
+	if (written_ && memcmp(shadow_.data(), data, shadow_.size()) == 0)
+		return;
+	memcpy(shadow_.data(), data, shadow_.size());
+	written_ = true;
+	CHECK_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, buffer_));
+	CHECK_GL_ERROR(glBufferSubData(GL_UNIFORM_BUFFER, 0, shadow_.size(), data));
+	CHECK_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
+
+int UniformBlock::findBinding(const std::string& name)
+{
+	auto iter = bindings_.find(name);
+	if (iter == bindings_.end())
+		return -1;
+	return int(iter->second);
+}
+
+std::map<std::string, unsigned> UniformBlock::bindings_;
+unsigned UniformBlock::next_binding_ = 0;
@@ -0,0 +1,48 @@
+#ifndef UNIFORM_BLOCK_H
+#define UNIFORM_BLOCK_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * UniformBlock: a uniform buffer shared by every program that declares a
+ * uniform block of the same name, e.g. the per-frame camera and light
+ * data in the terrain shaders.
+ *
+ * Each block takes the next binding point and keeps its buffer bound
+ * there. RenderPass links programs to the blocks they declare by name, so
+ * blocks must be created before the passes that use them. The contents
+ * are written once per update() instead of once per pass, and not at all
+ * if they did not change.
+ *
+ * The C++ struct passed to update() must follow the block's std140
+ * layout. Must be created after the GL context.
+ */
+class UniformBlock {
+public:
+	UniformBlock(const std::string& name, size_t bytes);
+	~UniformBlock();
+	UniformBlock(const UniformBlock&) = delete;
+	UniformBlock& operator=(const UniformBlock&) = delete;
+
+	// update: copies bytes() bytes of data to the buffer if they differ
+	// from the last update.
+	void update(const void* data);
+	size_t bytes() const { return shadow_.size(); }
+	unsigned binding() const { return binding_; }
+
+	// Binding point of the block called name, or -1 if there is none.
+	static int findBinding(const std::string& name);
+private:
+	std::string name_;
+	unsigned buffer_ = 0;
+	unsigned binding_ = 0;
+	bool written_ = false;
+	std::vector<char> shadow_; // contents of buffer_
+
+	static std::map<std::string, unsigned> bindings_;
+	static unsigned next_binding_;
+};
+
+#endif